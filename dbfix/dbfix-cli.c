@@ -33,7 +33,10 @@
  */
 
 #include "hyscan-fix-db.h"
+#include "hyscan-fix-cache.h"
+#include "hyscan-fix-plan.h"
 #include <string.h>
+#include <stdio.h>
 
 void
 clear (guint size)
@@ -48,23 +51,76 @@ clear (guint size)
   g_free (str);
 }
 
+/* Состояние обновления, отображаемое в строке статуса. */
+static HyScanFixDBProgress status_progress = { .eta = -1 };
+static gchar *status_message = NULL;
+static gint status_size = 0;
+
+/* Функция выводит строку статуса: прогресс, скорость обновления,
+ * оставшееся время и текущее действие. */
 void
-log_message (HyScanFixDB       *fix,
-             const gchar       *message,
-             HyScanCancellable *cancellable)
+print_status (void)
 {
   gchar *out_message;
-  static gint size = 0;
+  gchar eta[16];
+
+  if (status_progress.eta >= 0)
+    {
+      g_snprintf (eta, sizeof (eta), "%u:%02u:%02u",
+                  (guint)(status_progress.eta / 3600),
+                  (guint)((status_progress.eta / 60) % 60),
+                  (guint)(status_progress.eta % 60));
+    }
+  else
+    {
+      g_strlcpy (eta, "-:--:--", sizeof (eta));
+    }
 
-  clear (size);
-  out_message = g_strdup_printf ("[%3d%%]: %s",
-                                 (guint)(100.0 * hyscan_cancellable_get (cancellable)),
-                                 (message != NULL) ? message : "");
+  clear (status_size);
+  out_message = g_strdup_printf ("[%3d%%] %.1f MB/s, %.1f tracks/s, ETA %s: %s",
+                                 (guint)(100.0 * status_progress.progress),
+                                 status_progress.bytes_rate,
+                                 status_progress.tracks_rate,
+                                 eta,
+                                 (status_message != NULL) ? status_message : "");
   g_print ("%s", out_message);
-  size = strlen (out_message);
+  status_size = strlen (out_message);
   g_free (out_message);
 }
 
+void
+log_message (HyScanFixDB *fix,
+             const gchar *message,
+             gpointer     data)
+{
+  g_free (status_message);
+  status_message = g_strdup (message);
+
+  print_status ();
+}
+
+/* Сообщения об ошибках выводятся отдельными строками и не затираются
+ * строкой статуса. */
+void
+error_message (HyScanFixDB *fix,
+               const gchar *message,
+               gpointer     data)
+{
+  clear (status_size);
+  g_print ("%s\r\n", message);
+  status_size = 0;
+}
+
+void
+progress (HyScanFixDB               *fix,
+          const HyScanFixDBProgress *progress,
+          gpointer                   data)
+{
+  status_progress = *progress;
+
+  print_status ();
+}
+
 void
 completed (HyScanFixDB *fix,
            gboolean     status,
@@ -73,6 +129,142 @@ completed (HyScanFixDB *fix,
   g_main_loop_quit (loop);
 }
 
+/* Функция возвращает короткое название версии формата данных. */
+const gchar *
+version_name (HyScanFixSchemaType type,
+              gint                version,
+              gchar              *buffer)
+{
+  const HyScanFixSchema *schema = hyscan_fix_schema_get (type, version);
+
+  if (schema == NULL)
+    return "unknown";
+
+  g_strlcpy (buffer, schema->md5, 9);
+
+  return buffer;
+}
+
+/* Функция выводит план обновления базы данных. */
+void
+print_plan (HyScanFixPlan *plan,
+            guint          n_threads)
+{
+  gchar buffer[9];
+  gchar *size;
+  guint duration;
+  gint version;
+
+  g_print ("Projects:\r\n");
+  for (version = HYSCAN_FIX_PROJECT_UNKNOWN; version < HYSCAN_FIX_PROJECT_LAST; version++)
+    {
+      if (plan->n_projects[version] == 0)
+        continue;
+
+      g_print ("  %-8s %s %8u\r\n",
+               version_name (HYSCAN_FIX_SCHEMA_PROJECT, version, buffer),
+               (version == HYSCAN_FIX_PROJECT_LATEST) ? "latest" : "      ",
+               plan->n_projects[version]);
+    }
+
+  g_print ("Tracks:\r\n");
+  for (version = HYSCAN_FIX_TRACK_UNKNOWN; version < HYSCAN_FIX_TRACK_LAST; version++)
+    {
+      if (plan->n_tracks[version] == 0)
+        continue;
+
+      g_print ("  %-8s %s %8u\r\n",
+               version_name (HYSCAN_FIX_SCHEMA_TRACK, version, buffer),
+               (version == HYSCAN_FIX_TRACK_LATEST) ? "latest" : "      ",
+               plan->n_tracks[version]);
+    }
+
+  g_print ("\r\n");
+  g_print ("Units to update:     %u\r\n", plan->units->len);
+  g_print ("Interrupted updates: %u\r\n", plan->n_interrupted);
+
+  size = g_format_size (plan->cost.read_bytes);
+  g_print ("Data to read:        %s\r\n", size);
+  g_free (size);
+
+  size = g_format_size (plan->cost.write_bytes);
+  g_print ("Data to write:       %s\r\n", size);
+  g_free (size);
+
+  size = g_format_size (plan->cost.copy_bytes);
+  g_print ("Channel data copied: %s\r\n", size);
+  g_free (size);
+
+  g_print ("Files touched:       %" G_GUINT64_FORMAT "\r\n", plan->cost.n_files);
+
+  size = g_format_size (hyscan_fix_plan_get_space (plan, n_threads));
+  g_print ("Free space required: %s\r\n", size);
+  g_free (size);
+
+  duration = hyscan_fix_plan_get_duration (plan, n_threads) + 0.5;
+  g_print ("Estimated duration:  %u:%02u:%02u\r\n",
+           duration / 3600, (duration / 60) % 60, duration % 60);
+}
+
+/* Функция сканирует базу данных без её изменения. */
+gboolean
+scan (const gchar *db_path,
+      const gchar *plan_file,
+      guint        n_threads)
+{
+  HyScanFixPlan *plan;
+  gboolean status = TRUE;
+
+  hyscan_fix_cache_load (db_path);
+  plan = hyscan_fix_plan_scan (db_path, n_threads, NULL);
+  hyscan_fix_cache_clear (db_path);
+
+  if (plan == NULL)
+    return FALSE;
+
+  print_plan (plan, n_threads);
+
+  if (plan_file != NULL)
+    status = hyscan_fix_plan_save (plan, plan_file);
+
+  hyscan_fix_plan_free (plan);
+
+  return status;
+}
+
+/* Функция выводит отчёт об обновлении и, если задан файл, сохраняет
+ * в нём план повторного обновления объектов с ошибками. */
+gboolean
+print_report (const HyScanFixDBReport *report,
+              const gchar             *report_file)
+{
+  guint i;
+
+  if (report == NULL)
+    return TRUE;
+
+  g_print ("Updated: %u, failed: %u, skipped: %u of %u\r\n",
+           report->n_updated, report->n_failed, report->n_skipped, report->n_units);
+
+  for (i = 0; i < report->failed->units->len; i++)
+    {
+      HyScanFixPlanUnit *unit = report->failed->units->pdata[i];
+
+      if (unit->track != NULL)
+        g_print ("  failed track %s.%s\r\n", unit->project, unit->track);
+      else
+        g_print ("  failed parameters %s\r\n", unit->project);
+    }
+
+  if ((report_file != NULL) && !hyscan_fix_plan_save (report->failed, report_file))
+    {
+      g_print ("Can't save report %s\r\n", report_file);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
 int
 main (int    argc,
       char **argv)
@@ -81,10 +273,113 @@ main (int    argc,
   HyScanFixDB *fix;
   HyScanCancellable *cancellable;
 
-  if (argc != 2)
+  HyScanFixPlan *plan = NULL;
+  gchar *db_path = NULL;
+  gchar *plan_file = NULL;
+  gchar *shard = NULL;
+  gchar *report_file = NULL;
+  gchar *flush = NULL;
+  HyScanFixFlushMode flush_mode = HYSCAN_FIX_FLUSH_COMMIT;
+  gboolean dry_run = FALSE;
+  gboolean keep_going = FALSE;
+  gint n_threads = 0;
+  gint status = 0;
+
+  {
+    gchar **args;
+    GError *error = NULL;
+    GOptionContext *context;
+    GOptionEntry entries[] =
+      {
+        { "scan", 's', 0, G_OPTION_ARG_NONE, &dry_run, "Scan database and estimate update cost", NULL },
+        { "dry-run", 'n', 0, G_OPTION_ARG_NONE, &dry_run, "Same as --scan", NULL },
+        { "threads", 't', 0, G_OPTION_ARG_INT, &n_threads, "Number of parallel threads", NULL },
+        { "plan", 'p', 0, G_OPTION_ARG_FILENAME, &plan_file, "Save scan results to or execute upgrade plan from file", NULL },
+        { "shard", 0, 0, G_OPTION_ARG_STRING, &shard, "Execute only part of upgrade plan", "<index>/<count>" },
+        { "keep-going", 'k', 0, G_OPTION_ARG_NONE, &keep_going, "Roll back failed units and continue with the rest", NULL },
+        { "report", 'r', 0, G_OPTION_ARG_FILENAME, &report_file, "Save failed units as upgrade plan", NULL },
+        { "flush", 0, 0, G_OPTION_ARG_STRING, &flush, "Flush update journals to disk (default: commit)", "none|commit|always" },
+        { NULL }
+      };
+
+#ifdef G_OS_WIN32
+    args = g_win32_get_command_line ();
+#else
+    args = g_strdupv (argv);
+#endif
+
+    context = g_option_context_new ("<db-path>");
+    g_option_context_set_help_enabled (context, TRUE);
+    g_option_context_add_main_entries (context, entries, NULL);
+    g_option_context_set_ignore_unknown_options (context, FALSE);
+    if (!g_option_context_parse_strv (context, &args, &error))
+      {
+        g_print ("%s\r\n", error->message);
+        return -1;
+      }
+
+    /* База данных задаётся явно или берётся из плана обновления. */
+    if ((g_strv_length (args) > 2) ||
+        ((g_strv_length (args) < 2) && (dry_run || (plan_file == NULL))) ||
+        (n_threads < 0))
+      {
+        g_print ("%s", g_option_context_get_help (context, FALSE, NULL));
+        return 0;
+      }
+
+    g_option_context_free (context);
+
+    db_path = g_strdup (args[1]);
+    g_strfreev (args);
+  }
+
+  if (g_strcmp0 (flush, "none") == 0)
+    flush_mode = HYSCAN_FIX_FLUSH_NONE;
+  else if (g_strcmp0 (flush, "always") == 0)
+    flush_mode = HYSCAN_FIX_FLUSH_ALWAYS;
+  else if ((flush != NULL) && (g_strcmp0 (flush, "commit") != 0))
+    {
+      g_print ("Invalid flush mode %s\r\n", flush);
+      status = -1;
+      goto exit;
+    }
+
+  hyscan_fix_db_set_flush_mode (flush_mode);
+
+  if (dry_run)
     {
-      g_print ("Usage: dbfix-cli <db-path>\r\n\r\n");
-      return 0;
+      status = scan (db_path, plan_file, n_threads) ? 0 : -1;
+      goto exit;
+    }
+
+  if (plan_file != NULL)
+    {
+      guint shard_index = 0;
+      guint n_shards = 1;
+
+      if ((shard != NULL) &&
+          ((sscanf (shard, "%u/%u", &shard_index, &n_shards) != 2) || (shard_index >= n_shards)))
+        {
+          g_print ("Invalid shard %s\r\n", shard);
+          status = -1;
+          goto exit;
+        }
+
+      plan = hyscan_fix_plan_load (plan_file);
+      if (plan == NULL)
+        {
+          g_print ("Can't load upgrade plan %s\r\n", plan_file);
+          status = -1;
+          goto exit;
+        }
+
+      hyscan_fix_plan_select (plan, shard_index, n_shards);
+
+      if (db_path != NULL)
+        {
+          g_free (plan->db_path);
+          plan->db_path = g_strdup (db_path);
+        }
     }
 
   loop = g_main_loop_new (NULL, TRUE);
@@ -92,20 +387,45 @@ main (int    argc,
   fix = hyscan_fix_db_new ();
   cancellable = hyscan_cancellable_new ();
 
-  g_signal_connect (fix, "log", G_CALLBACK (log_message), cancellable);
+  hyscan_fix_db_set_threads (fix, n_threads);
+  hyscan_fix_db_set_keep_going (fix, keep_going);
+
+  g_signal_connect (fix, "log", G_CALLBACK (log_message), NULL);
+  g_signal_connect (fix, "error", G_CALLBACK (error_message), NULL);
+  g_signal_connect (fix, "progress", G_CALLBACK (progress), NULL);
   g_signal_connect (fix, "completed", G_CALLBACK (completed), loop);
 
-  hyscan_fix_db_upgrade (fix, argv[1], cancellable);
+  if (plan != NULL)
+    hyscan_fix_db_execute (fix, plan, cancellable);
+  else
+    hyscan_fix_db_upgrade (fix, db_path, cancellable);
 
   g_main_loop_run (loop);
 
   if (hyscan_fix_db_complete (fix))
-    g_print ("\r\nCompleted\r\n");
+    {
+      g_print ("\r\nCompleted\r\n");
+    }
   else
-    g_print ("\r\nFailed\r\n");
+    {
+      g_print ("\r\nFailed\r\n");
+      status = -1;
+    }
+
+  if (!print_report (hyscan_fix_db_get_report (fix), report_file))
+    status = -1;
 
   g_object_unref (cancellable);
   g_object_unref (fix);
+  g_main_loop_unref (loop);
+
+exit:
+  g_free (status_message);
+  g_free (db_path);
+  g_free (plan_file);
+  g_free (shard);
+  g_free (report_file);
+  g_free (flush);
 
-  return 0;
+  return status;
 }
@@ -0,0 +1,348 @@
+/* hyscan-fix-cache.c
+ *
+ * Copyright 2020 Screen LLC, Andrei Fadeev <andrei@webcontrol.ru>
+ *
+ * This file is part of HyScan DBFix.
+ *
+ * HyScan DBFix is dual-licensed: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HyScan DBFix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Alternatively, you can license this code under a commercial license.
+ * Contact the Screen LLC in this case - <info@screen-co.ru>.
+ */
+
+/* HyScan DBFix имеет двойную лицензию.
+ *
+ * Во-первых, вы можете распространять HyScan DBFix на условиях Стандартной
+ * Общественной Лицензии GNU версии 3, либо по любой более поздней версии
+ * лицензии (по вашему выбору). Полные положения лицензии GNU приведены в
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Во-вторых, этот программный код можно использовать по коммерческой
+ * лицензии. Для этого свяжитесь с ООО Экран - <info@screen-co.ru>.
+ */
+
+/* Кэш контрольных сумм файлов схем.
+ *
+ * Для определения версии проекта или галса необходимо посчитать MD5 сумму
+ * файла схемы. Кэш сопоставляет контрольную сумму с отпечатком файла:
+ * номером индексного дескриптора, размером и временем изменения. Если
+ * отпечаток файла не изменился, контрольная сумма берётся из кэша без
+ * чтения файла.
+ *
+ * Кэш хранится в корне базы данных в файле dbfix.cache. Каждая строка
+ * содержит путь к файлу относительно корня, отпечаток и контрольную сумму,
+ * разделённые символом табуляции. Файл кэша записывается атомарно.
+ */
+
+#include "hyscan-fix-cache.h"
+
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#define CACHE_FILE     "dbfix.cache"
+
+typedef struct _HyScanFixCacheEntry HyScanFixCacheEntry;
+struct _HyScanFixCacheEntry
+{
+  guint64              inode;              /* Номер индексного дескриптора. */
+  guint64              size;               /* Размер файла. */
+  gint64               mtime;              /* Время изменения файла, нс. */
+  gchar                md5[33];            /* Контрольная сумма. */
+  gboolean             used;               /* Признак использования записи. */
+};
+
+static GMutex          hyscan_fix_cache_lock;
+static GHashTable     *hyscan_fix_cache = NULL;
+
+/* Функция определяет отпечаток файла. */
+static gboolean
+hyscan_fix_cache_stat (const gchar         *file,
+                       HyScanFixCacheEntry *entry)
+{
+#ifdef HAVE_STATX
+  struct statx info;
+
+  if (statx (AT_FDCWD, file, 0, STATX_INO | STATX_SIZE | STATX_MTIME, &info) != 0)
+    return FALSE;
+
+  entry->inode = info.stx_ino;
+  entry->size = info.stx_size;
+  entry->mtime = G_GINT64_CONSTANT (1000000000) * info.stx_mtime.tv_sec + info.stx_mtime.tv_nsec;
+#else
+  GStatBuf info;
+
+  if (g_stat (file, &info) != 0)
+    return FALSE;
+
+  entry->inode = info.st_ino;
+  entry->size = info.st_size;
+#ifdef HAVE_STAT_ST_MTIM
+  entry->mtime = G_GINT64_CONSTANT (1000000000) * info.st_mtim.tv_sec + info.st_mtim.tv_nsec;
+#else
+  entry->mtime = G_GINT64_CONSTANT (1000000000) * info.st_mtime;
+#endif
+#endif
+
+  return TRUE;
+}
+
+/* Функция возвращает таблицу кэша. Функция должна вызываться
+ * с захваченной блокировкой hyscan_fix_cache_lock. */
+static GHashTable *
+hyscan_fix_cache_get (void)
+{
+  if (hyscan_fix_cache == NULL)
+    hyscan_fix_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+  return hyscan_fix_cache;
+}
+
+/**
+ * hyscan_fix_cache_load:
+ * @db_path: путь к базе данных (каталог с проектами)
+ *
+ * Функция загружает кэш контрольных сумм базы данных. Если файла кэша
+ * нет или он повреждён, кэш остаётся пустым.
+ *
+ * Returns: %TRUE если кэш загружен, иначе %FALSE.
+ */
+gboolean
+hyscan_fix_cache_load (const gchar *db_path)
+{
+  gboolean status = FALSE;
+  GHashTable *cache;
+  gchar *cache_file;
+  gchar *data = NULL;
+  gchar **lines = NULL;
+  gsize size;
+  guint i;
+
+  cache_file = g_build_filename (db_path, CACHE_FILE, NULL);
+
+  g_mutex_lock (&hyscan_fix_cache_lock);
+  cache = hyscan_fix_cache_get ();
+
+  if (!g_file_get_contents (cache_file, &data, &size, NULL))
+    goto exit;
+
+  lines = g_strsplit (data, "\n", -1);
+  for (i = 0; lines[i] != NULL; i++)
+    {
+      HyScanFixCacheEntry *entry;
+      gchar **fields;
+
+      fields = g_strsplit (lines[i], "\t", -1);
+      if ((g_strv_length (fields) == 5) && (strlen (fields[4]) == 32))
+        {
+          entry = g_new0 (HyScanFixCacheEntry, 1);
+          entry->inode = g_ascii_strtoull (fields[1], NULL, 10);
+          entry->size = g_ascii_strtoull (fields[2], NULL, 10);
+          entry->mtime = g_ascii_strtoll (fields[3], NULL, 10);
+          memcpy (entry->md5, fields[4], 32);
+
+          g_hash_table_insert (cache, g_build_filename (db_path, fields[0], NULL), entry);
+        }
+      g_strfreev (fields);
+    }
+
+  status = TRUE;
+
+exit:
+  g_mutex_unlock (&hyscan_fix_cache_lock);
+
+  g_strfreev (lines);
+  g_free (cache_file);
+  g_free (data);
+
+  return status;
+}
+
+/**
+ * hyscan_fix_cache_save:
+ * @db_path: путь к базе данных (каталог с проектами)
+ *
+ * Функция записывает кэш контрольных сумм файлов базы данных. Файл
+ * кэша заменяется атомарно.
+ *
+ * Returns: %TRUE если кэш записан, иначе %FALSE.
+ */
+gboolean
+hyscan_fix_cache_save (const gchar *db_path)
+{
+  gboolean status;
+  GHashTableIter iter;
+  gpointer key, value;
+  gchar *cache_file;
+  GFile *db_dir;
+  GString *data;
+
+  cache_file = g_build_filename (db_path, CACHE_FILE, NULL);
+  db_dir = g_file_new_for_path (db_path);
+  data = g_string_new (NULL);
+
+  g_mutex_lock (&hyscan_fix_cache_lock);
+
+  g_hash_table_iter_init (&iter, hyscan_fix_cache_get ());
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      HyScanFixCacheEntry *entry = value;
+      HyScanFixCacheEntry current;
+      GFile *file = g_file_new_for_path (key);
+      gchar *relative = g_file_get_relative_path (db_dir, file);
+
+      /* Сохраняются только файлы этой базы данных. Записи, которые не
+       * использовались при обновлении, сохраняются, только если файл ещё
+       * существует, иначе в кэше накапливались бы записи удалённых и
+       * переименованных галсов. */
+      if ((relative != NULL) && (strpbrk (relative, "\t\n") == NULL) &&
+          (entry->used || hyscan_fix_cache_stat (key, &current)))
+        {
+          g_string_append_printf (data, "%s\t%" G_GUINT64_FORMAT "\t%" G_GUINT64_FORMAT "\t%" G_GINT64_FORMAT "\t%s\n",
+                                  relative, entry->inode, entry->size, entry->mtime, entry->md5);
+        }
+
+      g_object_unref (file);
+      g_free (relative);
+    }
+
+  g_mutex_unlock (&hyscan_fix_cache_lock);
+
+  status = g_file_set_contents (cache_file, data->str, data->len, NULL);
+
+  g_string_free (data, TRUE);
+  g_object_unref (db_dir);
+  g_free (cache_file);
+
+  return status;
+}
+
+/**
+ * hyscan_fix_cache_clear:
+ * @db_path: путь к базе данных (каталог с проектами)
+ *
+ * Функция удаляет из кэша контрольные суммы файлов базы данных. Записи
+ * других баз данных, которые могут обновляться одновременно, остаются.
+ */
+void
+hyscan_fix_cache_clear (const gchar *db_path)
+{
+  GHashTableIter iter;
+  gpointer key;
+  gsize length;
+
+  length = strlen (db_path);
+  while ((length > 1) && G_IS_DIR_SEPARATOR (db_path[length - 1]))
+    length--;
+
+  g_mutex_lock (&hyscan_fix_cache_lock);
+
+  g_hash_table_iter_init (&iter, hyscan_fix_cache_get ());
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    {
+      const gchar *file = key;
+
+      if ((strncmp (file, db_path, length) == 0) && G_IS_DIR_SEPARATOR (file[length]))
+        g_hash_table_iter_remove (&iter);
+    }
+
+  if (g_hash_table_size (hyscan_fix_cache) == 0)
+    g_clear_pointer (&hyscan_fix_cache, g_hash_table_unref);
+
+  g_mutex_unlock (&hyscan_fix_cache_lock);
+}
+
+/**
+ * hyscan_fix_cache_lookup:
+ * @db_path: путь к базе данных (каталог с проектами)
+ * @file_path: путь к файлу относительно db_path
+ *
+ * Функция возвращает контрольную сумму файла из кэша, если отпечаток
+ * файла не изменился.
+ *
+ * Returns: (nullable): MD5 сумма файла или %NULL. Для удаления #g_free.
+ */
+gchar *
+hyscan_fix_cache_lookup (const gchar *db_path,
+                         const gchar *file_path)
+{
+  HyScanFixCacheEntry current;
+  HyScanFixCacheEntry *entry;
+  gchar *md5 = NULL;
+  gchar *file;
+
+  file = g_build_filename (db_path, file_path, NULL);
+
+  if (!hyscan_fix_cache_stat (file, &current))
+    goto exit;
+
+  g_mutex_lock (&hyscan_fix_cache_lock);
+
+  entry = g_hash_table_lookup (hyscan_fix_cache_get (), file);
+  if ((entry != NULL) &&
+      (entry->inode == current.inode) &&
+      (entry->size == current.size) &&
+      (entry->mtime == current.mtime))
+    {
+      entry->used = TRUE;
+      md5 = g_strdup (entry->md5);
+    }
+
+  g_mutex_unlock (&hyscan_fix_cache_lock);
+
+exit:
+  g_free (file);
+
+  return md5;
+}
+
+/**
+ * hyscan_fix_cache_update:
+ * @db_path: путь к базе данных (каталог с проектами)
+ * @file_path: путь к файлу относительно db_path
+ * @md5: контрольная сумма файла
+ *
+ * Функция сохраняет в кэше контрольную сумму файла вместе с его текущим
+ * отпечатком.
+ */
+void
+hyscan_fix_cache_update (const gchar *db_path,
+                         const gchar *file_path,
+                         const gchar *md5)
+{
+  HyScanFixCacheEntry *entry;
+  gchar *file;
+
+  if ((md5 == NULL) || (strlen (md5) != 32))
+    return;
+
+  file = g_build_filename (db_path, file_path, NULL);
+
+  entry = g_new0 (HyScanFixCacheEntry, 1);
+  memcpy (entry->md5, md5, 32);
+  entry->used = TRUE;
+
+  if (!hyscan_fix_cache_stat (file, entry))
+    {
+      g_free (entry);
+      g_free (file);
+      return;
+    }
+
+  g_mutex_lock (&hyscan_fix_cache_lock);
+  g_hash_table_replace (hyscan_fix_cache_get (), file, entry);
+  g_mutex_unlock (&hyscan_fix_cache_lock);
+}
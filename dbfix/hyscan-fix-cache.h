@@ -0,0 +1,58 @@
+/* hyscan-fix-cache.h
+ *
+ * Copyright 2020 Screen LLC, Andrei Fadeev <andrei@webcontrol.ru>
+ *
+ * This file is part of HyScan DBFix.
+ *
+ * HyScan DBFix is dual-licensed: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HyScan DBFix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Alternatively, you can license this code under a commercial license.
+ * Contact the Screen LLC in this case - <info@screen-co.ru>.
+ */
+
+/* HyScan DBFix имеет двойную лицензию.
+ *
+ * Во-первых, вы можете распространять HyScan DBFix на условиях Стандартной
+ * Общественной Лицензии GNU версии 3, либо по любой более поздней версии
+ * лицензии (по вашему выбору). Полные положения лицензии GNU приведены в
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Во-вторых, этот программный код можно использовать по коммерческой
+ * лицензии. Для этого свяжитесь с ООО Экран - <info@screen-co.ru>.
+ */
+
+
+#ifndef __HYSCAN_FIX_CACHE_H__
+#define __HYSCAN_FIX_CACHE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+gboolean               hyscan_fix_cache_load       (const gchar   *db_path);
+
+gboolean               hyscan_fix_cache_save       (const gchar   *db_path);
+
+void                   hyscan_fix_cache_clear      (const gchar   *db_path);
+
+gchar *                hyscan_fix_cache_lookup     (const gchar   *db_path,
+                                                    const gchar   *file_path);
+
+void                   hyscan_fix_cache_update     (const gchar   *db_path,
+                                                    const gchar   *file_path,
+                                                    const gchar   *md5);
+
+G_END_DECLS
+
+#endif /* __HYSCAN_FIX_CACHE_H__ */
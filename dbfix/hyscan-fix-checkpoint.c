@@ -0,0 +1,351 @@
+/* hyscan-fix-checkpoint.c
+ *
+ * Copyright 2020 Screen LLC, Andrei Fadeev <andrei@webcontrol.ru>
+ *
+ * This file is part of HyScan DBFix.
+ *
+ * HyScan DBFix is dual-licensed: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HyScan DBFix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Alternatively, you can license this code under a commercial license.
+ * Contact the Screen LLC in this case - <info@screen-co.ru>.
+ */
+
+/* HyScan DBFix имеет двойную лицензию.
+ *
+ * Во-первых, вы можете распространять HyScan DBFix на условиях Стандартной
+ * Общественной Лицензии GNU версии 3, либо по любой более поздней версии
+ * лицензии (по вашему выбору). Полные положения лицензии GNU приведены в
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Во-вторых, этот программный код можно использовать по коммерческой
+ * лицензии. Для этого свяжитесь с ООО Экран - <info@screen-co.ru>.
+ */
+
+/* Журнал завершённых объектов обновления.
+ *
+ * После успешного обновления галса или параметров проекта в журнал
+ * добавляется запись об этом. При повторном запуске прерванного обновления
+ * объекты из журнала пропускаются без проверки их версии, а обновление
+ * продолжается с объекта, который обновлялся в момент прерывания. Его
+ * изменения откатываются по журналам обновления.
+ *
+ * Журнал хранится в корне базы данных в файле dbfix.checkpoint. Каждая
+ * строка содержит MD5 сумму схемы, до которой обновлён объект, название
+ * проекта и название галса, разделённые символом табуляции. Для параметров
+ * проекта название галса пустое. Записи с устаревшей версией схемы, а также
+ * недописанная последняя строка игнорируются. Объекты, в названиях которых
+ * есть символы табуляции или перевода строки, в журнал не записываются и
+ * при повторном запуске проверяются заново.
+ *
+ * После успешного завершения обновления журнал удаляется.
+ */
+
+#include "hyscan-fix-checkpoint.h"
+#include "hyscan-fix-common.h"
+#include "hyscan-fix-project.h"
+#include "hyscan-fix-track.h"
+
+#include <glib/gstdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#ifdef G_OS_WIN32
+#include <io.h>
+#define fsync _commit
+#else
+#include <unistd.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#define CHECKPOINT_FILE        "dbfix.checkpoint"
+
+/* Журнал базы данных. */
+typedef struct
+{
+  GHashTable          *units;              /* Завершённые объекты обновления. */
+  gchar               *file;               /* Путь к файлу журнала. */
+  gint                 fd;                 /* Дескриптор файла журнала. */
+} HyScanFixCheckpoint;
+
+/* Журналы открываются для каждой базы данных отдельно, что позволяет
+ * одновременно обновлять разные базы данных. Журналы хранятся по
+ * каноническому пути к базе данных, поэтому разные записи одного пути
+ * соответствуют одному журналу. */
+static GMutex          hyscan_fix_checkpoint_lock;
+static GHashTable     *hyscan_fix_checkpoints = NULL;
+
+/* Функция закрывает журнал. */
+static void
+hyscan_fix_checkpoint_free (gpointer data)
+{
+  HyScanFixCheckpoint *checkpoint = data;
+
+  if (checkpoint->fd >= 0)
+    close (checkpoint->fd);
+
+  g_hash_table_unref (checkpoint->units);
+  g_free (checkpoint->file);
+  g_slice_free (HyScanFixCheckpoint, checkpoint);
+}
+
+/* Функция формирует ключ объекта обновления. */
+static gchar *
+hyscan_fix_checkpoint_key (const gchar *project_name,
+                           const gchar *track_name)
+{
+  return g_strconcat (project_name, "\t", (track_name != NULL) ? track_name : "", NULL);
+}
+
+/* Функция возвращает MD5 сумму актуальной схемы объекта. */
+static const gchar *
+hyscan_fix_checkpoint_latest (const gchar *track_name)
+{
+  const HyScanFixSchema *schema;
+
+  if (track_name != NULL)
+    schema = hyscan_fix_schema_get (HYSCAN_FIX_SCHEMA_TRACK, HYSCAN_FIX_TRACK_LATEST);
+  else
+    schema = hyscan_fix_schema_get (HYSCAN_FIX_SCHEMA_PROJECT, HYSCAN_FIX_PROJECT_LATEST);
+
+  return schema->md5;
+}
+
+/* Функция возвращает открытый журнал базы данных. Функция должна
+ * вызываться с захваченной блокировкой hyscan_fix_checkpoint_lock. */
+static HyScanFixCheckpoint *
+hyscan_fix_checkpoint_get (const gchar *db_path)
+{
+  HyScanFixCheckpoint *checkpoint;
+  gchar *db_key;
+
+  if (hyscan_fix_checkpoints == NULL)
+    return NULL;
+
+  db_key = g_canonicalize_filename (db_path, NULL);
+  checkpoint = g_hash_table_lookup (hyscan_fix_checkpoints, db_key);
+  g_free (db_key);
+
+  return checkpoint;
+}
+
+/**
+ * hyscan_fix_checkpoint_open:
+ * @db_path: путь к базе данных (каталог с проектами)
+ *
+ * Функция загружает журнал завершённых объектов обновления и открывает
+ * его для добавления записей. Журнал базы данных может быть открыт
+ * только одним обновлением.
+ *
+ * Returns: %TRUE если журнал открыт, иначе %FALSE.
+ */
+gboolean
+hyscan_fix_checkpoint_open (const gchar *db_path)
+{
+  HyScanFixCheckpoint *checkpoint = NULL;
+  gchar *data = NULL;
+  gchar **lines = NULL;
+  gboolean status = FALSE;
+  guint i;
+
+  g_mutex_lock (&hyscan_fix_checkpoint_lock);
+
+  if (hyscan_fix_checkpoint_get (db_path) != NULL)
+    goto exit;
+
+  checkpoint = g_slice_new0 (HyScanFixCheckpoint);
+  checkpoint->units = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  checkpoint->file = g_build_filename (db_path, CHECKPOINT_FILE, NULL);
+  checkpoint->fd = -1;
+
+  if (g_file_get_contents (checkpoint->file, &data, NULL, NULL))
+    {
+      lines = g_strsplit (data, "\n", -1);
+
+      /* Последняя строка либо пустая, либо недописанная. */
+      for (i = 0; (lines[i] != NULL) && (lines[i + 1] != NULL); i++)
+        {
+          gchar **fields = g_strsplit (lines[i], "\t", -1);
+
+          if (g_strv_length (fields) == 3)
+            {
+              const gchar *track_name = (fields[2][0] != 0) ? fields[2] : NULL;
+
+              if (g_strcmp0 (fields[0], hyscan_fix_checkpoint_latest (track_name)) == 0)
+                g_hash_table_add (checkpoint->units, hyscan_fix_checkpoint_key (fields[1], track_name));
+            }
+
+          g_strfreev (fields);
+        }
+    }
+
+  /* Недописанная строка отделяется от новых записей. */
+  checkpoint->fd = g_open (checkpoint->file, O_WRONLY | O_CREAT | O_APPEND | O_BINARY, 0644);
+  if (checkpoint->fd < 0)
+    goto exit;
+
+  if ((data != NULL) && (data[0] != 0) && !g_str_has_suffix (data, "\n"))
+    {
+      if (write (checkpoint->fd, "\n", 1) != 1)
+        goto exit;
+    }
+
+  if (hyscan_fix_checkpoints == NULL)
+    {
+      hyscan_fix_checkpoints = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                      g_free, hyscan_fix_checkpoint_free);
+    }
+  g_hash_table_insert (hyscan_fix_checkpoints, g_canonicalize_filename (db_path, NULL),
+                       g_steal_pointer (&checkpoint));
+
+  status = TRUE;
+
+exit:
+  g_mutex_unlock (&hyscan_fix_checkpoint_lock);
+
+  if (checkpoint != NULL)
+    hyscan_fix_checkpoint_free (checkpoint);
+
+  g_strfreev (lines);
+  g_free (data);
+
+  return status;
+}
+
+/**
+ * hyscan_fix_checkpoint_contains:
+ * @db_path: путь к базе данных (каталог с проектами)
+ * @project_name: название проекта
+ * @track_name: (nullable): название галса или NULL для параметров проекта
+ *
+ * Функция проверяет, завершено ли обновление объекта.
+ *
+ * Returns: %TRUE если обновление объекта завершено, иначе %FALSE.
+ */
+gboolean
+hyscan_fix_checkpoint_contains (const gchar *db_path,
+                                const gchar *project_name,
+                                const gchar *track_name)
+{
+  HyScanFixCheckpoint *checkpoint;
+  gboolean contains = FALSE;
+  gchar *key;
+
+  key = hyscan_fix_checkpoint_key (project_name, track_name);
+
+  g_mutex_lock (&hyscan_fix_checkpoint_lock);
+  checkpoint = hyscan_fix_checkpoint_get (db_path);
+  if (checkpoint != NULL)
+    contains = g_hash_table_contains (checkpoint->units, key);
+  g_mutex_unlock (&hyscan_fix_checkpoint_lock);
+
+  g_free (key);
+
+  return contains;
+}
+
+/**
+ * hyscan_fix_checkpoint_commit:
+ * @db_path: путь к базе данных (каталог с проектами)
+ * @project_name: название проекта
+ * @track_name: (nullable): название галса или NULL для параметров проекта
+ *
+ * Функция добавляет в журнал запись о завершении обновления объекта.
+ * Запись сбрасывается на диск, если это предусмотрено режимом сброса
+ * журналов обновления.
+ *
+ * Returns: %TRUE если запись добавлена, иначе %FALSE.
+ */
+gboolean
+hyscan_fix_checkpoint_commit (const gchar *db_path,
+                              const gchar *project_name,
+                              const gchar *track_name)
+{
+  HyScanFixCheckpoint *checkpoint;
+  gboolean status = FALSE;
+  gchar *line;
+  gsize size;
+
+  if ((strpbrk (project_name, "\t\n") != NULL) ||
+      ((track_name != NULL) && (strpbrk (track_name, "\t\n") != NULL)))
+    {
+      return TRUE;
+    }
+
+  line = g_strdup_printf ("%s\t%s\t%s\n", hyscan_fix_checkpoint_latest (track_name),
+                          project_name, (track_name != NULL) ? track_name : "");
+  size = strlen (line);
+
+  g_mutex_lock (&hyscan_fix_checkpoint_lock);
+
+  checkpoint = hyscan_fix_checkpoint_get (db_path);
+  if (checkpoint == NULL)
+    goto exit;
+
+  /* Запись одним вызовом в режиме добавления не перемешивается
+   * с записями других потоков. */
+  if (write (checkpoint->fd, line, size) != (gssize)size)
+    goto exit;
+
+  if ((hyscan_fix_journal_get_mode () != HYSCAN_FIX_FLUSH_NONE) &&
+      (fsync (checkpoint->fd) != 0))
+    {
+      goto exit;
+    }
+
+  g_hash_table_add (checkpoint->units, hyscan_fix_checkpoint_key (project_name, track_name));
+  status = TRUE;
+
+exit:
+  g_mutex_unlock (&hyscan_fix_checkpoint_lock);
+
+  g_free (line);
+
+  return status;
+}
+
+/**
+ * hyscan_fix_checkpoint_close:
+ * @db_path: путь к базе данных (каталог с проектами)
+ * @completed: признак успешного завершения обновления
+ *
+ * Функция закрывает журнал завершённых объектов обновления. Если
+ * обновление успешно завершено, журнал удаляется.
+ */
+void
+hyscan_fix_checkpoint_close (const gchar *db_path,
+                             gboolean     completed)
+{
+  HyScanFixCheckpoint *checkpoint;
+
+  g_mutex_lock (&hyscan_fix_checkpoint_lock);
+
+  checkpoint = hyscan_fix_checkpoint_get (db_path);
+  if (checkpoint != NULL)
+    {
+      gchar *db_key;
+
+      if (completed)
+        g_unlink (checkpoint->file);
+
+      db_key = g_canonicalize_filename (db_path, NULL);
+      g_hash_table_remove (hyscan_fix_checkpoints, db_key);
+      g_free (db_key);
+    }
+
+  g_mutex_unlock (&hyscan_fix_checkpoint_lock);
+}
@@ -33,14 +33,468 @@
  */
 
 #include "hyscan-fix-common.h"
+#include "hyscan-fix-cache.h"
 
 #include <glib/gstdio.h>
 #include <gio/gio.h>
 #include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#ifdef G_OS_WIN32
+#include <io.h>
+#define fsync _commit
+#else
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#define COPY_BUFFER_SIZE       (4 * 1024 * 1024)       /* Размер буфера копирования. */
+#define COPY_RANGE_SIZE        (16 * 1024 * 1024)      /* Размер блока для copy_file_range. */
 
 #define BACKUP_INDEX   "update.backup"
 #define CLEANUP_INDEX  "update.cleanup"
 #define UPDATE_LOG     "update.log"
+#define RENAME_INDEX   "update.rename"
+
+struct _HyScanFixDirIter
+{
+#ifdef G_OS_WIN32
+  GDir                *dir;                /* Каталог. */
+  gchar               *path;               /* Путь к каталогу. */
+#else
+  DIR                 *dir;                /* Каталог. */
+#endif
+};
+
+typedef struct _HyScanFixJournal HyScanFixJournal;
+struct _HyScanFixJournal
+{
+  gint                 fd;                 /* Дескриптор файла журнала. */
+  gboolean             dirty;              /* Признак наличия несброшенных на диск записей. */
+};
+
+static const gchar        *hyscan_fix_journal_names[] = { BACKUP_INDEX, CLEANUP_INDEX, RENAME_INDEX, UPDATE_LOG };
+
+/* Журналы, наличие которых означает прерванное обновление. Лог обновления
+ * к ним не относится, он только дополняет журналы. */
+static const gchar        *hyscan_fix_journal_markers[] = { BACKUP_INDEX, CLEANUP_INDEX, RENAME_INDEX };
+
+static GMutex              hyscan_fix_journal_lock;
+static GHashTable         *hyscan_fix_journals = NULL;
+static HyScanFixFlushMode  hyscan_fix_journal_flush_mode = HYSCAN_FIX_FLUSH_COMMIT;
+
+/* Функция закрывает журнал. */
+static void
+hyscan_fix_journal_free (gpointer data)
+{
+  HyScanFixJournal *journal = data;
+
+  if (journal->dirty && (hyscan_fix_journal_flush_mode != HYSCAN_FIX_FLUSH_NONE))
+    fsync (journal->fd);
+
+  close (journal->fd);
+  g_free (journal);
+}
+
+/* Функция возвращает открытый журнал. Функция должна вызываться
+ * с захваченной блокировкой hyscan_fix_journal_lock. */
+static HyScanFixJournal *
+hyscan_fix_journal_get (const gchar *file)
+{
+  HyScanFixJournal *journal;
+  gint fd;
+
+  if (hyscan_fix_journals == NULL)
+    {
+      hyscan_fix_journals = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                   g_free, hyscan_fix_journal_free);
+    }
+
+  journal = g_hash_table_lookup (hyscan_fix_journals, file);
+  if (journal != NULL)
+    return journal;
+
+  fd = g_open (file, O_WRONLY | O_CREAT | O_APPEND | O_BINARY, 0644);
+  if (fd < 0)
+    return NULL;
+
+  journal = g_new0 (HyScanFixJournal, 1);
+  journal->fd = fd;
+  g_hash_table_insert (hyscan_fix_journals, g_strdup (file), journal);
+
+  return journal;
+}
+
+/* Функция закрывает журнал, если он открыт. */
+static void
+hyscan_fix_journal_close_file (const gchar *file)
+{
+  g_mutex_lock (&hyscan_fix_journal_lock);
+  if (hyscan_fix_journals != NULL)
+    g_hash_table_remove (hyscan_fix_journals, file);
+  g_mutex_unlock (&hyscan_fix_journal_lock);
+}
+
+/* Функция записывает данные в файл целиком. */
+static gboolean
+hyscan_fix_fd_write (gint         fd,
+                     const gchar *data,
+                     gsize        size)
+{
+  while (size > 0)
+    {
+      gssize written = write (fd, data, size);
+
+      if (written < 0)
+        {
+          if (errno == EINTR)
+            continue;
+
+          return FALSE;
+        }
+
+      data += written;
+      size -= written;
+    }
+
+  return TRUE;
+}
+
+/* Функция сообщает о ходе копирования по текущей позиции исходного
+ * файла и проверяет, не отменено ли копирование. При отмене возвращается
+ * FALSE, а в errno записывается ECANCELED. */
+static gboolean
+hyscan_fix_fd_copy_progress (gint               src_fd,
+                             goffset            size,
+                             HyScanCancellable *cancellable)
+{
+  goffset offset;
+
+  if (cancellable == NULL)
+    return TRUE;
+
+  if (g_cancellable_is_cancelled (G_CANCELLABLE (cancellable)))
+    {
+      errno = ECANCELED;
+      return FALSE;
+    }
+
+  offset = lseek (src_fd, 0, SEEK_CUR);
+  if ((offset >= 0) && (size > 0))
+    hyscan_cancellable_set_total (cancellable, MIN (offset, size), 0, size);
+
+  return TRUE;
+}
+
+/* Функция копирует данные средствами ядра без передачи через
+ * пространство пользователя. Копирование начинается с текущих
+ * позиций файлов и выполняется блоками, между которыми проверяется
+ * отмена. В случае ошибки, кроме отмены, копирование можно продолжить
+ * другим способом с позиций, на которых оно остановилось. */
+static gboolean
+hyscan_fix_fd_copy_range (gint               src_fd,
+                          gint               dst_fd,
+                          goffset            size,
+                          HyScanCancellable *cancellable)
+{
+#ifdef HAVE_COPY_FILE_RANGE
+  while (TRUE)
+    {
+      gssize copied;
+
+      if (!hyscan_fix_fd_copy_progress (src_fd, size, cancellable))
+        return FALSE;
+
+      copied = copy_file_range (src_fd, NULL, dst_fd, NULL, COPY_RANGE_SIZE, 0);
+
+      if (copied == 0)
+        return TRUE;
+
+      if (copied < 0)
+        {
+          if (errno == EINTR)
+            continue;
+
+          return FALSE;
+        }
+    }
+#else
+  errno = ENOSYS;
+  return FALSE;
+#endif
+}
+
+/* Функция считывает данные блоками, начиная с текущей позиции файла,
+ * и, если указаны, записывает их в файл dst_fd и добавляет к контрольной
+ * сумме checksum. Размер буфера не превышает размера файла и ограничен
+ * COPY_BUFFER_SIZE. Если указан cancellable, перед каждым блоком
+ * проверяется отмена. */
+static gboolean
+hyscan_fix_fd_copy_stream (gint               src_fd,
+                           gint               dst_fd,
+                           GChecksum         *checksum,
+                           goffset            size,
+                           HyScanCancellable *cancellable)
+{
+  gboolean status = FALSE;
+  gsize buffer_size = COPY_BUFFER_SIZE;
+  gchar *buffer;
+  GStatBuf info;
+
+  /* Упреждающее чтение ядром совмещает чтение с обработкой данных. */
+#ifdef POSIX_FADV_SEQUENTIAL
+  posix_fadvise (src_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+  /* Небольшие файлы, например параметры, считываются за одно чтение
+   * без выделения полного буфера. */
+  if ((fstat (src_fd, &info) == 0) && (info.st_size < COPY_BUFFER_SIZE))
+    buffer_size = MAX (info.st_size, 1);
+
+  buffer = g_malloc (buffer_size);
+
+  while (TRUE)
+    {
+      gssize length;
+
+      if (!hyscan_fix_fd_copy_progress (src_fd, size, cancellable))
+        goto exit;
+
+      length = read (src_fd, buffer, buffer_size);
+
+      if (length == 0)
+        break;
+
+      if (length < 0)
+        {
+          if (errno == EINTR)
+            continue;
+
+          goto exit;
+        }
+
+      if (checksum != NULL)
+        g_checksum_update (checksum, (const guchar *)buffer, length);
+
+      if ((dst_fd >= 0) && !hyscan_fix_fd_write (dst_fd, buffer, length))
+        goto exit;
+    }
+
+  status = TRUE;
+
+exit:
+  g_free (buffer);
+
+  return status;
+}
+
+/* Функция копирует содержимое файла через буфер и одновременно считает
+ * MD5 сумму скопированных данных. Если dst_file равен NULL, данные только
+ * считываются. В случае ошибки её код сохраняется в errno. */
+static gchar *
+hyscan_fix_file_copy_checksum (const gchar *src_file,
+                               const gchar *dst_file)
+{
+  GChecksum *checksum = NULL;
+  gchar *md5 = NULL;
+  GStatBuf info;
+  gint src_fd = -1;
+  gint dst_fd = -1;
+  gint error;
+
+  src_fd = g_open (src_file, O_RDONLY | O_BINARY, 0);
+  if (src_fd < 0)
+    return NULL;
+
+  if (dst_file != NULL)
+    {
+      if (fstat (src_fd, &info) != 0)
+        goto exit;
+
+      dst_fd = g_open (dst_file, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, info.st_mode & 0777);
+      if (dst_fd < 0)
+        goto exit;
+    }
+
+  checksum = g_checksum_new (G_CHECKSUM_MD5);
+  if (!hyscan_fix_fd_copy_stream (src_fd, dst_fd, checksum, 0, NULL))
+    goto exit;
+
+  if ((dst_fd >= 0) && (hyscan_fix_journal_flush_mode != HYSCAN_FIX_FLUSH_NONE) && (fsync (dst_fd) != 0))
+    goto exit;
+
+  md5 = g_strdup (g_checksum_get_string (checksum));
+
+exit:
+  error = errno;
+
+  if (checksum != NULL)
+    g_checksum_free (checksum);
+  if (src_fd >= 0)
+    close (src_fd);
+  if ((dst_fd >= 0) && (close (dst_fd) != 0))
+    g_clear_pointer (&md5, g_free);
+
+  errno = error;
+
+  return md5;
+}
+
+/* Функция копирует содержимое файла. Сначала выполняется попытка
+ * создать ссылку на данные исходного файла (reflink), что для btrfs и
+ * XFS не требует копирования данных. Затем данные копируются средствами
+ * ядра (copy_file_range) и, если это невозможно, через буфер. Данные
+ * копируются блоками, между которыми проверяется отмена и обновляется
+ * прогресс cancellable. Незавершённая копия удаляется. В случае ошибки
+ * её код сохраняется в errno, при отмене это ECANCELED. */
+static gboolean
+hyscan_fix_file_copy_data (const gchar       *src_file,
+                           const gchar       *dst_file,
+                           HyScanCancellable *cancellable)
+{
+  gboolean status = FALSE;
+  GStatBuf info;
+  gint src_fd = -1;
+  gint dst_fd = -1;
+  gint error;
+
+  src_fd = g_open (src_file, O_RDONLY | O_BINARY, 0);
+  if (src_fd < 0)
+    return FALSE;
+
+  if (fstat (src_fd, &info) != 0)
+    goto exit;
+
+  dst_fd = g_open (dst_file, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, info.st_mode & 0777);
+  if (dst_fd < 0)
+    goto exit;
+
+#ifdef FICLONE
+  if (ioctl (dst_fd, FICLONE, src_fd) == 0)
+    {
+      status = TRUE;
+      goto exit;
+    }
+#endif
+
+  if (!hyscan_fix_fd_copy_range (src_fd, dst_fd, info.st_size, cancellable) &&
+      ((errno == ECANCELED) ||
+       !hyscan_fix_fd_copy_stream (src_fd, dst_fd, NULL, info.st_size, cancellable)))
+    {
+      goto exit;
+    }
+
+  /* Оригинальный файл будет удалён при уборке, поэтому копия
+   * должна оказаться на диске до этого момента. */
+  if ((hyscan_fix_journal_flush_mode != HYSCAN_FIX_FLUSH_NONE) && (fsync (dst_fd) != 0))
+    goto exit;
+
+  status = TRUE;
+
+exit:
+  error = errno;
+
+  if (src_fd >= 0)
+    close (src_fd);
+  if ((dst_fd >= 0) && (close (dst_fd) != 0))
+    status = FALSE;
+  if ((dst_fd >= 0) && !status)
+    g_unlink (dst_file);
+
+  errno = error;
+
+  return status;
+}
+
+/* Функция отменяет переименования файлов в порядке, обратном их выполнению. */
+static gboolean
+hyscan_fix_revert_moves (const gchar *db_path)
+{
+  gboolean status = FALSE;
+  gchar *rename_index = NULL;
+  gchar **list = NULL;
+  gchar *data = NULL;
+  gint i;
+
+  rename_index = g_build_filename (db_path, RENAME_INDEX, NULL);
+  if (!g_file_get_contents (rename_index, &data, NULL, NULL))
+    {
+      status = TRUE;
+      goto exit;
+    }
+
+  list = g_strsplit (data, "\n", -1);
+  for (i = g_strv_length (list) - 1; i >= 0; i--)
+    {
+      gchar **info = g_strsplit (list[i], ": ", 2);
+      gboolean reverted = TRUE;
+
+      if ((info[0] != NULL) && (info[1] != NULL))
+        {
+          gchar *dst_file = g_build_filename (db_path, info[0], NULL);
+          gchar *src_file = g_build_filename (db_path, info[1], NULL);
+
+          /* Если файл не был переименован, он остаётся на старом месте. */
+          if (g_file_test (dst_file, G_FILE_TEST_EXISTS))
+            reverted = (g_rename (dst_file, src_file) == 0);
+          else
+            reverted = g_file_test (src_file, G_FILE_TEST_EXISTS);
+
+          g_free (dst_file);
+          g_free (src_file);
+        }
+
+      g_strfreev (info);
+
+      if (!reverted)
+        goto exit;
+    }
+
+  status = TRUE;
+
+exit:
+  g_strfreev (list);
+  g_free (rename_index);
+  g_free (data);
+
+  return status;
+}
+
+/**
+ * hyscan_fix_journal_exist:
+ * @path: путь к каталогу
+ *
+ * Функция проверяет наличие журналов обновления в каталоге. Наличие
+ * журналов означает, что обновление каталога было прервано.
+ *
+ * Returns: %TRUE если журналы обновления есть, иначе %FALSE.
+ */
+gboolean
+hyscan_fix_journal_exist (const gchar *path)
+{
+  gboolean exist = FALSE;
+  guint i;
+
+  for (i = 0; !exist && i < G_N_ELEMENTS (hyscan_fix_journal_markers); i++)
+    {
+      gchar *file = g_build_filename (path, hyscan_fix_journal_markers[i], NULL);
+      exist = g_file_test (file, G_FILE_TEST_EXISTS);
+      g_free (file);
+    }
+
+  return exist;
+}
 
 /**
  * hyscan_fix_id_create:
@@ -73,6 +527,125 @@ hyscan_fix_id_create (void)
   return g_strdup (buffer);
 }
 
+/**
+ * hyscan_fix_dir_iter_new:
+ * @path: рабочий путь
+ *
+ * Функция открывает каталог для последовательного чтения его элементов.
+ * Элементы возвращаются по мере чтения каталога, без предварительного
+ * составления полного списка.
+ *
+ * Returns: (nullable): указатель на #HyScanFixDirIter или %NULL в случае
+ * ошибки. Для удаления #hyscan_fix_dir_iter_free.
+ */
+HyScanFixDirIter *
+hyscan_fix_dir_iter_new (const gchar *path)
+{
+  HyScanFixDirIter *iter;
+
+#ifdef G_OS_WIN32
+  GDir *dir = g_dir_open (path, 0, NULL);
+#else
+  DIR *dir = opendir (path);
+#endif
+
+  if (dir == NULL)
+    return NULL;
+
+  iter = g_slice_new0 (HyScanFixDirIter);
+  iter->dir = dir;
+#ifdef G_OS_WIN32
+  iter->path = g_strdup (path);
+#endif
+
+  return iter;
+}
+
+/**
+ * hyscan_fix_dir_iter_next:
+ * @iter: указатель на #HyScanFixDirIter
+ * @name: (out): название элемента каталога
+ * @is_dir: (out) (optional): признак каталога
+ *
+ * Функция возвращает следующий элемент каталога. Тип элемента определяется
+ * по данным каталога, а если файловая система их не предоставляет, то
+ * запросом относительно открытого каталога. Символьные ссылки разыменовываются.
+ * Название действительно до следующего вызова функции.
+ *
+ * Returns: %TRUE если элемент прочитан, %FALSE если элементов больше нет.
+ */
+gboolean
+hyscan_fix_dir_iter_next (HyScanFixDirIter  *iter,
+                          const gchar      **name,
+                          gboolean          *is_dir)
+{
+#ifdef G_OS_WIN32
+  const gchar *entry = g_dir_read_name (iter->dir);
+
+  if (entry == NULL)
+    return FALSE;
+
+  if (is_dir != NULL)
+    {
+      gchar *full = g_build_filename (iter->path, entry, NULL);
+      *is_dir = g_file_test (full, G_FILE_TEST_IS_DIR);
+      g_free (full);
+    }
+
+  *name = entry;
+
+  return TRUE;
+#else
+  struct dirent *entry;
+
+  while ((entry = readdir (iter->dir)) != NULL)
+    {
+      if ((g_strcmp0 (entry->d_name, ".") == 0) || (g_strcmp0 (entry->d_name, "..") == 0))
+        continue;
+
+      if (is_dir != NULL)
+        {
+          struct stat info;
+
+#ifdef _DIRENT_HAVE_D_TYPE
+          if ((entry->d_type != DT_UNKNOWN) && (entry->d_type != DT_LNK))
+            *is_dir = (entry->d_type == DT_DIR);
+          else
+#endif
+            *is_dir = (fstatat (dirfd (iter->dir), entry->d_name, &info, 0) == 0) && S_ISDIR (info.st_mode);
+        }
+
+      *name = entry->d_name;
+
+      return TRUE;
+    }
+
+  return FALSE;
+#endif
+}
+
+/**
+ * hyscan_fix_dir_iter_free:
+ * @iter: указатель на #HyScanFixDirIter
+ *
+ * Функция закрывает каталог.
+ */
+void
+hyscan_fix_dir_iter_free (HyScanFixDirIter *iter)
+{
+  if (iter == NULL)
+    return;
+
+#ifdef G_OS_WIN32
+  g_dir_close (iter->dir);
+  g_free (iter->path);
+#else
+  closedir (iter->dir);
+#endif
+
+  g_slice_free (HyScanFixDirIter, iter);
+}
+
 /**
  * hyscan_fix_dir_list:
  * @path: рабочий путь
@@ -85,32 +658,27 @@ hyscan_fix_id_create (void)
 gchar **
 hyscan_fix_dir_list (const gchar *path)
 {
-  GDir *dir;
+  HyScanFixDirIter *iter;
   const gchar *name;
-  GArray *names;
+  gboolean is_dir;
+  GPtrArray *names;
 
-  dir = g_dir_open (path, 0, NULL);
-  if (dir == NULL)
+  iter = hyscan_fix_dir_iter_new (path);
+  if (iter == NULL)
     return NULL;
 
-  names = g_array_new (TRUE, TRUE, sizeof (gchar *));
+  names = g_ptr_array_new ();
 
-  while ((name = g_dir_read_name (dir)) != NULL)
+  while (hyscan_fix_dir_iter_next (iter, &name, &is_dir))
     {
-      gchar *full = g_build_filename (path, name, NULL);
-
-      if (g_file_test (full, G_FILE_TEST_IS_DIR))
-        {
-          gchar *copy = g_strdup (name);
-          g_array_append_val (names, copy);
-        }
-
-      g_free (full);
+      if (is_dir)
+        g_ptr_array_add (names, g_strdup (name));
     }
 
-  g_dir_close (dir);
+  g_ptr_array_add (names, NULL);
+  hyscan_fix_dir_iter_free (iter);
 
-  return (gchar**)g_array_free (names, FALSE);
+  return (gchar **)g_ptr_array_free (names, FALSE);
 }
 
 /**
@@ -145,7 +713,8 @@ hyscan_fix_file_exist (const gchar *db_path,
  * @db_path: путь к базе данных (каталог с проектами)
  * @file_path: путь к файлу относительно db_path
  *
- * Функция считает MD5 сумму для данных в файле.
+ * Функция считает MD5 сумму для данных в файле. Файл считывается блоками,
+ * поэтому объём используемой памяти не зависит от размера файла.
  *
  * Returns: (transfer full): Строка md5 хэшем содержимого файла.
  * Для удаления #g_free.
@@ -155,21 +724,55 @@ hyscan_fix_file_md5 (const gchar *db_path,
                      const gchar *file_path)
 {
   gchar *file;
-  gchar *data;
   gchar *md5;
-  gsize size;
 
   file = g_build_filename (db_path, file_path, NULL);
+  md5 = hyscan_fix_file_copy_checksum (file, NULL);
+  g_free (file);
 
-  if (!g_file_get_contents (file, &data, &size, NULL))
-    return NULL;
+  return md5;
+}
 
-  md5 = g_compute_checksum_for_string (G_CHECKSUM_MD5, data, size);
+/**
+ * hyscan_fix_file_digest:
+ * @db_path: путь к базе данных (каталог с проектами)
+ * @file_path: путь к файлу относительно db_path
+ * @digest: (out): MD5 сумма в двоичном виде
+ *
+ * Функция считает MD5 сумму для данных в файле и возвращает её в двоичном
+ * виде. Размер буфера @digest должен быть не меньше 16 байт.
+ *
+ * Returns: %TRUE если сумма посчитана, иначе %FALSE.
+ */
+gboolean
+hyscan_fix_file_digest (const gchar *db_path,
+                        const gchar *file_path,
+                        guint8      *digest)
+{
+  gboolean status = FALSE;
+  GChecksum *checksum;
+  gsize digest_len = 16;
+  gchar *file;
+  gint fd;
 
-  g_free (data);
+  file = g_build_filename (db_path, file_path, NULL);
+  fd = g_open (file, O_RDONLY | O_BINARY, 0);
   g_free (file);
 
-  return md5;
+  if (fd < 0)
+    return FALSE;
+
+  checksum = g_checksum_new (G_CHECKSUM_MD5);
+  if (hyscan_fix_fd_copy_stream (fd, -1, checksum, 0, NULL))
+    {
+      g_checksum_get_digest (checksum, digest, &digest_len);
+      status = TRUE;
+    }
+
+  g_checksum_free (checksum);
+  close (fd);
+
+  return status;
 }
 
 /**
@@ -215,7 +818,9 @@ exit:
  * @file_path: путь к файлу относительно db_path
  * @str: строка для добавления к файлу
  *
- * Функция  добавляет строку к файлу.
+ * Функция добавляет строку к файлу. Файл открывается один раз в режиме
+ * добавления и остаётся открытым до вызова #hyscan_fix_journal_close,
+ * поэтому стоимость записи не зависит от размера файла.
  *
  * Returns: %TRUE если строка добавлена, иначе %FALSE.
  */
@@ -224,29 +829,34 @@ hyscan_fix_file_append (const gchar *db_path,
                         const gchar *file_path,
                         const gchar *str)
 {
-  gboolean status;
+  HyScanFixJournal *journal;
+  gboolean status = FALSE;
   gchar *file;
-  gchar *data;
-  gsize size;
-  gsize len;
 
-  len = strlen (str);
   file = g_build_filename (db_path, file_path, NULL);
 
-  if (!g_file_get_contents (file, &data, &size, NULL))
+  g_mutex_lock (&hyscan_fix_journal_lock);
+
+  journal = hyscan_fix_journal_get (file);
+  if (journal == NULL)
+    goto exit;
+
+  if (!hyscan_fix_fd_write (journal->fd, str, strlen (str)))
+    goto exit;
+
+  journal->dirty = TRUE;
+  if (hyscan_fix_journal_flush_mode == HYSCAN_FIX_FLUSH_ALWAYS)
     {
-      data = NULL;
-      size = 0;
+      if (fsync (journal->fd) != 0)
+        goto exit;
+      journal->dirty = FALSE;
     }
 
-  data = g_realloc (data, size + len + 1);
-  g_snprintf (data + size, len + 1, "%s", str);
-
-  size += len;
-  status = g_file_set_contents (file, data, size, NULL);
+  status = TRUE;
 
+exit:
+  g_mutex_unlock (&hyscan_fix_journal_lock);
   g_free (file);
-  g_free (data);
 
   return status;
 }
@@ -258,7 +868,8 @@ hyscan_fix_file_append (const gchar *db_path,
  * @exist: TRUE если файл должен существовать
  *
  * Функция создаёт резервную копию файла и сохраняет информацию о ней
- * в файле с откатом изменений.
+ * в файле с откатом изменений. Копирование и расчёт контрольной суммы
+ * выполняются за один проход по файлу.
  *
  * Returns: %TRUE если резервная копия создана, иначе %FALSE.
  */
@@ -272,23 +883,23 @@ hyscan_fix_file_backup (const gchar *db_path,
   gchar *cleanup_index = NULL;
   gchar *from = NULL;
   gchar *to = NULL;
-  gchar *data = NULL;
   gchar *md5 = NULL;
-  gsize size;
 
   from = g_build_filename (db_path, file_path, NULL);
   to = g_strdup_printf ("%s.bak", from);
 
-  if (!g_file_get_contents (from, &data, &size, NULL))
+  /* Резервная копия могла остаться от прерванного обновления. */
+  g_unlink (to);
+
+  md5 = hyscan_fix_file_copy_checksum (from, to);
+
+  if (md5 == NULL)
     {
-      status = !exist;
+      if (errno == ENOENT)
+        status = !exist;
       goto exit;
     }
 
-  if (!g_file_set_contents (to, data, size, NULL))
-    goto exit;
-
-  md5 = g_compute_checksum_for_string (G_CHECKSUM_MD5, data, size);
   backup_index = g_strdup_printf ("%s: %s\n", file_path, md5);
   if (!hyscan_fix_file_append (db_path, BACKUP_INDEX, backup_index))
     goto exit;
@@ -297,14 +908,18 @@ hyscan_fix_file_backup (const gchar *db_path,
   if (!hyscan_fix_file_append (db_path, CLEANUP_INDEX, cleanup_index))
     goto exit;
 
-  status = hyscan_fix_log (db_path, "backup file %s\n", file_path);
+  if (!hyscan_fix_log (db_path, "backup file %s\n", file_path))
+    goto exit;
+
+  /* Запись о резервной копии должна оказаться на диске раньше,
+   * чем будет изменён оригинальный файл. */
+  status = hyscan_fix_journal_flush (db_path);
 
 exit:
   g_free (cleanup_index);
   g_free (backup_index);
   g_free (from);
   g_free (to);
-  g_free (data);
   g_free (md5);
 
   return status;
@@ -316,35 +931,36 @@ exit:
  * @src_path: исходный путь к файлу относительно db_path
  * @dst_path: целевой путь к файлу относительно db_path
  * @exist: TRUE если файл должен существовать
+ * @cancellable: (nullable): указатель на #HyScanCancellable
  *
  * Функция копирует файл и сохраняет информацию о необходимости удаления
- * оригинального файла.
+ * оригинального файла. Если файловая система поддерживает ссылки на данные
+ * (reflink), копирование выполняется без переноса данных.
+ *
+ * Данные копируются блоками. Между блоками проверяется отмена, а в
+ * @cancellable передаётся доля скопированных данных. При отмене
+ * незавершённая копия удаляется и функция возвращает %FALSE.
  *
  * Returns: %TRUE если копия создана, иначе %FALSE.
  */
 gboolean
-hyscan_fix_file_copy (const gchar *db_path,
-                      const gchar *src_path,
-                      const gchar *dst_path,
-                      gboolean     exist)
+hyscan_fix_file_copy (const gchar       *db_path,
+                      const gchar       *src_path,
+                      const gchar       *dst_path,
+                      gboolean           exist,
+                      HyScanCancellable *cancellable)
 {
   gboolean status = FALSE;
   gchar *cleanup_index = NULL;
   gchar *src_file = NULL;
   gchar *dst_file = NULL;
-  GFile *src = NULL;
-  GFile *dst = NULL;
-  GError *error = NULL;
 
   src_file = g_build_filename (db_path, src_path, NULL);
   dst_file = g_build_filename (db_path, dst_path, NULL);
 
-  src = g_file_new_for_path (src_file);
-  dst = g_file_new_for_path (dst_file);
-
-  if (!g_file_copy (src, dst, G_FILE_COPY_OVERWRITE, NULL, NULL, NULL, &error))
+  if (!hyscan_fix_file_copy_data (src_file, dst_file, cancellable))
     {
-      if (error->code == G_IO_ERROR_NOT_FOUND)
+      if (errno == ENOENT)
         status = !exist;
       goto exit;
     }
@@ -356,8 +972,65 @@ hyscan_fix_file_copy (const gchar *db_path,
   status = hyscan_fix_log (db_path, "copy file %s\n", src_path);
 
 exit:
-  g_clear_object (&src);
-  g_clear_object (&dst);
+  g_free (cleanup_index);
+  g_free (src_file);
+  g_free (dst_file);
+
+  return status;
+}
+
+/**
+ * hyscan_fix_file_move:
+ * @db_path: путь к базе данных (каталог с проектами)
+ * @src_path: исходный путь к файлу относительно db_path
+ * @dst_path: целевой путь к файлу относительно db_path
+ * @exist: TRUE если файл должен существовать
+ *
+ * Функция переименовывает файл и сохраняет информацию для отмены
+ * переименования. Существующий целевой файл не заменяется, в этом
+ * случае функция возвращает %FALSE, а файл остаётся на старом месте.
+ *
+ * Returns: %TRUE если файл переименован, иначе %FALSE.
+ */
+gboolean
+hyscan_fix_file_move (const gchar *db_path,
+                      const gchar *src_path,
+                      const gchar *dst_path,
+                      gboolean     exist)
+{
+  gboolean status = FALSE;
+  gchar *rename_index = NULL;
+  gchar *src_file = NULL;
+  gchar *dst_file = NULL;
+
+  src_file = g_build_filename (db_path, src_path, NULL);
+  dst_file = g_build_filename (db_path, dst_path, NULL);
+
+  if (!g_file_test (src_file, G_FILE_TEST_EXISTS))
+    {
+      status = !exist;
+      goto exit;
+    }
+
+  if (g_file_test (dst_file, G_FILE_TEST_EXISTS))
+    goto exit;
+
+  /* Запись об обратном переименовании должна оказаться на диске
+   * раньше, чем будет переименован файл. */
+  rename_index = g_strdup_printf ("%s: %s\n", dst_path, src_path);
+  if (!hyscan_fix_file_append (db_path, RENAME_INDEX, rename_index))
+    goto exit;
+
+  if (!hyscan_fix_journal_flush (db_path))
+    goto exit;
+
+  if (g_rename (src_file, dst_file) != 0)
+    goto exit;
+
+  status = hyscan_fix_log (db_path, "move file %s\n", src_path);
+
+exit:
+  g_free (rename_index);
   g_free (src_file);
   g_free (dst_file);
 
@@ -391,41 +1064,33 @@ hyscan_fix_file_mark_remove (const gchar *db_path,
  * hyscan_fix_file_schema:
  * @db_path: путь к базе данных (каталог с проектами)
  * @file_path: путь к файлу относительно db_path
- * @schema_version: версия схемы данных
+ * @schema: описание схемы данных
  *
- * Функция записывает в файл новую схему данных с указанной версией.
+ * Функция записывает в файл новую схему данных. Содержимое схемы берётся
+ * из таблицы, встроенной в программу при сборке.
  *
  * Returns: %TRUE если схема записана, иначе %FALSE.
  */
 gboolean
-hyscan_fix_file_schema (const gchar *db_path,
-                        const gchar *file_path,
-                        const gchar *schema_version)
+hyscan_fix_file_schema (const gchar           *db_path,
+                        const gchar           *file_path,
+                        const HyScanFixSchema *schema)
 {
-  gboolean status = FALSE;
-  gchar *schema_id = NULL;
-  gchar *schema_file = NULL;
-  GBytes *schema = NULL;
-  const gchar *data;
-  gsize size;
-
-  schema_id = g_strdup_printf ("/org/hyscan/schemas/%s", schema_version);
-  schema_file = g_build_filename (db_path, file_path, NULL);
+  gboolean status;
+  gchar *schema_file;
 
-  schema = g_resources_lookup_data (schema_id, 0, NULL);
   if (schema == NULL)
-    goto exit;
+    return FALSE;
 
-  data = g_bytes_get_data (schema, &size);
-  if (data == NULL)
-    goto exit;
+  schema_file = g_build_filename (db_path, file_path, NULL);
+  status = g_file_set_contents (schema_file, (const gchar *)schema->data, schema->size, NULL);
 
-  status = g_file_set_contents (schema_file, data, size, NULL);
+  /* Контрольная сумма новой схемы известна заранее. Если обновление будет
+   * отменено, файл схемы заменится резервной копией с другим отпечатком. */
+  if (status)
+    hyscan_fix_cache_update (db_path, file_path, schema->md5);
 
-exit:
-  g_free (schema_id);
   g_free (schema_file);
-  g_clear_pointer (&schema, g_bytes_unref);
 
   return status;
 }
@@ -474,6 +1139,7 @@ hyscan_fix_cleanup (const gchar *db_path)
 {
   gboolean status = FALSE;
   gchar *backup_index = NULL;
+  gchar *rename_index = NULL;
   gchar *update_log = NULL;
   gchar *cleanup_index = NULL;
   gchar **list = NULL;
@@ -482,10 +1148,14 @@ hyscan_fix_cleanup (const gchar *db_path)
   guint i;
 
   backup_index = g_build_filename (db_path, BACKUP_INDEX, NULL);
+  rename_index = g_build_filename (db_path, RENAME_INDEX, NULL);
   update_log = g_build_filename (db_path, UPDATE_LOG, NULL);
   cleanup_index = g_build_filename (db_path, CLEANUP_INDEX, NULL);
 
+  hyscan_fix_journal_close (db_path);
+
   g_unlink (backup_index);
+  g_unlink (rename_index);
   g_unlink (update_log);
 
   if (g_file_get_contents (cleanup_index, &data, &size, NULL))
@@ -498,8 +1168,9 @@ hyscan_fix_cleanup (const gchar *db_path)
         {
           gchar *file;
 
+          /* Файл мог быть удалён или переименован обратно при откате. */
           file = g_build_filename (db_path, list[i], NULL);
-          status = (g_unlink (file) == 0);
+          status = (g_unlink (file) == 0) || (errno == ENOENT);
           g_free (file);
 
           if (!status)
@@ -514,6 +1185,7 @@ hyscan_fix_cleanup (const gchar *db_path)
 exit:
   g_strfreev (list);
   g_free (backup_index);
+  g_free (rename_index);
   g_free (update_log);
   g_free (cleanup_index);
   g_free (data);
@@ -525,7 +1197,8 @@ exit:
  * hyscan_fix_revert:
  * @db_path: путь к базе данных (каталог с проектами)
  *
- * функция отменяет изменения в проекте или галсе из бэкапа.
+ * функция отменяет изменения в проекте или галсе из бэкапа и возвращает
+ * переименованные файлы на старые места.
  *
  * Returns: %TRUE если изменения отменены, иначе %FALSE.
  */
@@ -538,11 +1211,16 @@ hyscan_fix_revert (const gchar *db_path)
   gchar **info = NULL;
   gchar *file = NULL;
   gchar *from = NULL;
+  gchar *temp = NULL;
   gchar *md5 = NULL;
   gchar *data = NULL;
   gsize size;
   guint i;
 
+  /* Возвращаем переименованные файлы на старые места. */
+  if (!hyscan_fix_revert_moves (db_path))
+    return FALSE;
+
   backup_index = g_build_filename (db_path, BACKUP_INDEX, NULL);
   if (g_file_get_contents (backup_index, &data, &size, NULL))
     {
@@ -557,23 +1235,26 @@ hyscan_fix_revert (const gchar *db_path)
             {
               file = g_build_filename (db_path, info[0], NULL);
               from = g_strdup_printf ("%s.bak", file);
+              temp = g_strdup_printf ("%s.tmp", file);
 
-              g_free (data);
-              if (!g_file_get_contents (from, &data, &size, NULL))
-                goto exit;
-
-              md5 = g_compute_checksum_for_string (G_CHECKSUM_MD5, data, size);
+              /* Резервная копия проверяется во время копирования и заменяет
+               * файл целиком, поэтому повреждённая копия не затрёт файл. */
+              md5 = hyscan_fix_file_copy_checksum (from, temp);
               if (g_strcmp0 (md5, info[1]) != 0)
-                goto exit;
+                {
+                  g_unlink (temp);
+                  goto exit;
+                }
 
-              if (!g_file_set_contents (file, data, size, NULL))
+              if (g_rename (temp, file) != 0)
                 goto exit;
 
-              g_clear_pointer (&data, g_free);
               g_clear_pointer (&file, g_free);
               g_clear_pointer (&from, g_free);
+              g_clear_pointer (&temp, g_free);
               g_clear_pointer (&md5, g_free);
             }
+          g_clear_pointer (&info, g_strfreev);
         }
     }
 
@@ -586,7 +1267,106 @@ exit:
   g_free (data);
   g_free (file);
   g_free (from);
+  g_free (temp);
   g_free (md5);
 
   return status;
 }
+
+/**
+ * hyscan_fix_journal_set_mode:
+ * @mode: режим сброса журналов на диск
+ *
+ * Функция устанавливает режим сброса журналов обновления на диск.
+ * По умолчанию используется режим %HYSCAN_FIX_FLUSH_COMMIT.
+ */
+void
+hyscan_fix_journal_set_mode (HyScanFixFlushMode mode)
+{
+  g_mutex_lock (&hyscan_fix_journal_lock);
+  hyscan_fix_journal_flush_mode = mode;
+  g_mutex_unlock (&hyscan_fix_journal_lock);
+}
+
+/**
+ * hyscan_fix_journal_get_mode:
+ *
+ * Функция возвращает режим сброса журналов обновления на диск.
+ *
+ * Returns: Режим сброса журналов на диск.
+ */
+HyScanFixFlushMode
+hyscan_fix_journal_get_mode (void)
+{
+  HyScanFixFlushMode mode;
+
+  g_mutex_lock (&hyscan_fix_journal_lock);
+  mode = hyscan_fix_journal_flush_mode;
+  g_mutex_unlock (&hyscan_fix_journal_lock);
+
+  return mode;
+}
+
+/**
+ * hyscan_fix_journal_flush:
+ * @db_path: путь к базе данных (каталог с проектами)
+ *
+ * Функция сбрасывает на диск журналы обновления. Функция вызывается
+ * в точках фиксации, после которых изменяются данные базы. В режиме
+ * %HYSCAN_FIX_FLUSH_NONE функция ничего не делает.
+ *
+ * Returns: %TRUE если журналы сброшены, иначе %FALSE.
+ */
+gboolean
+hyscan_fix_journal_flush (const gchar *db_path)
+{
+  gboolean status = TRUE;
+  guint i;
+
+  g_mutex_lock (&hyscan_fix_journal_lock);
+
+  if ((hyscan_fix_journals == NULL) || (hyscan_fix_journal_flush_mode == HYSCAN_FIX_FLUSH_NONE))
+    goto exit;
+
+  for (i = 0; i < G_N_ELEMENTS (hyscan_fix_journal_names); i++)
+    {
+      HyScanFixJournal *journal;
+      gchar *file;
+
+      file = g_build_filename (db_path, hyscan_fix_journal_names[i], NULL);
+      journal = g_hash_table_lookup (hyscan_fix_journals, file);
+      g_free (file);
+
+      if ((journal == NULL) || !journal->dirty)
+        continue;
+
+      if (fsync (journal->fd) != 0)
+        status = FALSE;
+      else
+        journal->dirty = FALSE;
+    }
+
+exit:
+  g_mutex_unlock (&hyscan_fix_journal_lock);
+
+  return status;
+}
+
+/**
+ * hyscan_fix_journal_close:
+ * @db_path: путь к базе данных (каталог с проектами)
+ *
+ * Функция сбрасывает на диск и закрывает журналы обновления.
+ */
+void
+hyscan_fix_journal_close (const gchar *db_path)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (hyscan_fix_journal_names); i++)
+    {
+      gchar *file = g_build_filename (db_path, hyscan_fix_journal_names[i], NULL);
+      hyscan_fix_journal_close_file (file);
+      g_free (file);
+    }
+}
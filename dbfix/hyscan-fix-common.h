@@ -35,10 +35,46 @@
 #ifndef __HYSCAN_FIX_COMMON_H__
 #define __HYSCAN_FIX_COMMON_H__
 
-#include <glib.h>
+#include <hyscan-cancellable.h>
+#include "hyscan-fix-schema.h"
 
 G_BEGIN_DECLS
 
+/**
+ * HyScanFixFlushMode:
+ * @HYSCAN_FIX_FLUSH_NONE: сброс журналов на диск выполняется операционной системой
+ * @HYSCAN_FIX_FLUSH_COMMIT: сброс журналов на диск в точках фиксации
+ * @HYSCAN_FIX_FLUSH_ALWAYS: сброс журналов на диск после каждой записи
+ *
+ * Режимы сброса журналов обновления на диск.
+ */
+typedef enum
+{
+  HYSCAN_FIX_FLUSH_NONE,
+  HYSCAN_FIX_FLUSH_COMMIT,
+  HYSCAN_FIX_FLUSH_ALWAYS
+} HyScanFixFlushMode;
+
+typedef struct _HyScanFixDirIter HyScanFixDirIter;
+
+/**
+ * HyScanFixCost:
+ * @read_bytes: объём считываемых данных
+ * @write_bytes: объём записываемых данных, включая резервные копии
+ * @copy_bytes: объём копируемых данных каналов (входит в @write_bytes)
+ * @n_files: число изменяемых, создаваемых и удаляемых файлов
+ *
+ * Оценка затрат на обновление.
+ */
+typedef struct _HyScanFixCost HyScanFixCost;
+struct _HyScanFixCost
+{
+  guint64      read_bytes;
+  guint64      write_bytes;
+  guint64      copy_bytes;
+  guint64      n_files;
+};
+
 typedef struct _HyScanFixFileIDType HyScanFixFileIDType;
 struct _HyScanFixFileIDType
 {
@@ -49,6 +85,14 @@ struct _HyScanFixFileIDType
 
 gchar *                hyscan_fix_id_create        (void);
 
+HyScanFixDirIter *     hyscan_fix_dir_iter_new     (const gchar   *path);
+
+gboolean               hyscan_fix_dir_iter_next    (HyScanFixDirIter *iter,
+                                                    const gchar     **name,
+                                                    gboolean         *is_dir);
+
+void                   hyscan_fix_dir_iter_free    (HyScanFixDirIter *iter);
+
 gchar **               hyscan_fix_dir_list         (const gchar   *path);
 
 gboolean               hyscan_fix_file_exist       (const gchar   *db_path,
@@ -57,6 +101,10 @@ gboolean               hyscan_fix_file_exist       (const gchar   *db_path,
 gchar *                hyscan_fix_file_md5         (const gchar   *db_path,
                                                     const gchar   *file_path);
 
+gboolean               hyscan_fix_file_digest      (const gchar   *db_path,
+                                                    const gchar   *file_path,
+                                                    guint8        *digest);
+
 HyScanFixFileIDType    hyscan_fix_file_db_id       (const gchar   *db_path,
                                                     const gchar   *file_path);
 
@@ -68,7 +116,13 @@ gboolean               hyscan_fix_file_backup      (const gchar   *db_path,
                                                     const gchar   *file_path,
                                                     gboolean       exist);
 
-gboolean               hyscan_fix_file_copy        (const gchar   *db_path,
+gboolean               hyscan_fix_file_copy        (const gchar       *db_path,
+                                                    const gchar       *src_path,
+                                                    const gchar       *dst_path,
+                                                    gboolean           exist,
+                                                    HyScanCancellable *cancellable);
+
+gboolean               hyscan_fix_file_move        (const gchar   *db_path,
                                                     const gchar   *src_path,
                                                     const gchar   *dst_path,
                                                     gboolean       exist);
@@ -76,9 +130,9 @@ gboolean               hyscan_fix_file_copy        (const gchar   *db_path,
 gboolean               hyscan_fix_file_mark_remove (const gchar   *db_path,
                                                     const gchar   *file_path);
 
-gboolean               hyscan_fix_file_schema      (const gchar   *db_path,
-                                                    const gchar   *file_path,
-                                                    const gchar   *schema_version);
+gboolean               hyscan_fix_file_schema      (const gchar           *db_path,
+                                                    const gchar           *file_path,
+                                                    const HyScanFixSchema *schema);
 
 gboolean               hyscan_fix_log              (const gchar   *db_path,
                                                     const gchar   *format,
@@ -88,6 +142,16 @@ gboolean               hyscan_fix_cleanup          (const gchar   *db_path);
 
 gboolean               hyscan_fix_revert           (const gchar   *db_path);
 
+void                   hyscan_fix_journal_set_mode (HyScanFixFlushMode mode);
+
+HyScanFixFlushMode     hyscan_fix_journal_get_mode (void);
+
+gboolean               hyscan_fix_journal_flush    (const gchar   *db_path);
+
+gboolean               hyscan_fix_journal_exist    (const gchar   *path);
+
+void                   hyscan_fix_journal_close    (const gchar   *db_path);
+
 G_END_DECLS
 
 #endif /* __HYSCAN_FIX_COMMON_H__ */
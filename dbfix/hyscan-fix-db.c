@@ -42,54 +42,153 @@
  * время которого пользователю доступна информация о прогрессе обновления и
  * текущем выполняемом шаге.
  *
- * Запуск обновления производится с помощью функции #hyscan_fix_db_upgrade.
- * После получения сигнала о завершении обновления, необходимо вызвать функцию
- * #hyscan_fix_db_complete.
+ * Обновление выполняется в два этапа. Сначала база данных сканируется и
+ * составляется план обновления (#HyScanFixPlan), затем план выполняется.
+ * Функция #hyscan_fix_db_upgrade выполняет оба этапа, функция
+ * #hyscan_fix_db_execute выполняет готовый план, например загруженный из
+ * файла или его часть. После получения сигнала о завершении обновления,
+ * необходимо вызвать функцию #hyscan_fix_db_complete.
  */
 
 #include <glib/gi18n.h>
 
 #include "hyscan-fix-db.h"
 #include "hyscan-fix-common.h"
+#include "hyscan-fix-cache.h"
+#include "hyscan-fix-checkpoint.h"
 #include "hyscan-fix-project.h"
 #include "hyscan-fix-track.h"
 
 #include <hyscan-db.h>
+#include <string.h>
 
-#define HYSCAN_FIX_DB_INFO_TIMEOUT 100     /* Задержка между сигналами об изменениях, милисекунды. */
+#define HYSCAN_FIX_DB_INFO_TIMEOUT 100     /* Минимальный интервал между сигналами об изменениях, милисекунды. */
+#define HYSCAN_FIX_DB_RATE_PERIOD  1000000 /* Интервал измерения скорости обновления, микросекунды. */
 
 enum
 {
   SIGNAL_LOG,
+  SIGNAL_ERROR,
+  SIGNAL_PROGRESS,
   SIGNAL_COMPLETED,
   SIGNAL_LAST
 };
 
+/* Сообщение для основного потока. */
+typedef struct
+{
+  gboolean             error;              /* Признак сообщения об ошибке. */
+  gchar               *message;            /* Текст сообщения. */
+} HyScanFixDBEvent;
+
+/* Состояние обновления галсов проекта. */
+typedef struct
+{
+  HyScanFixDB         *fix;                /* Указатель на объект обновления. */
+  const gchar         *project_name;       /* Название проекта. */
+  gint                 status;             /* Статус обновления галсов. */
+} HyScanFixDBProject;
+
 struct _HyScanFixDBPrivate
 {
   GMutex               lock;               /* Блокировка. */
   GThread             *upgrader;           /* Поток обновления проектов. */
   gchar               *db_path;            /* Путь к обновляемым проектам. */
+  HyScanFixPlan       *plan;               /* План обновления. */
   HyScanCancellable   *cancellable;        /* Управление обновлением. */
-
-  guint                alerter;            /* Идентификатор обработчика сигнализирующего об изменениях. */
-  gchar               *log_message;        /* Описание текущего действия. */
+  guint                n_threads;          /* Число потоков обновления галсов. */
+  gboolean             keep_going;         /* Признак продолжения обновления после ошибок. */
+  HyScanFixDBReport   *report;             /* Отчёт о выполнении плана обновления. */
+
+  GMainContext        *context;            /* Контекст, в котором посылаются сигналы. */
+  GMutex               events_lock;        /* Блокировка очереди сообщений. */
+  GQueue               events;             /* Очередь сообщений HyScanFixDBEvent. */
+  GSource             *dispatcher;         /* Источник доставки сообщений, если она запланирована. */
   gboolean             status;             /* Статус обновления. */
   gboolean             completed;          /* Признак завершения обновления. */
+
+  GMutex               progress_lock;      /* Блокировка состояния выполнения плана. */
+  GHashTable          *active;             /* Обновляемые галсы: HyScanCancellable -> HyScanFixPlanUnit. */
+  gboolean             running;            /* Признак выполнения плана обновления. */
+  gboolean             restart;            /* Признак начала выполнения нового плана. */
+  guint64              total_work;         /* Общий объём работы, байт. */
+  guint64              done_work;          /* Объём работы по завершённым объектам, байт. */
+  HyScanFixDBProgress  progress;           /* Состояние выполнения по завершённым объектам. */
+
+  gint64               rate_time;          /* Время начала интервала измерения скорости. */
+  gdouble              rate_work;          /* Объём работы в начале интервала. */
+  gdouble              rate_bytes;         /* Объём данных в начале интервала. */
+  guint                rate_tracks;        /* Число галсов в начале интервала. */
+  gboolean             rate_valid;         /* Признак измеренной скорости. */
+  gdouble              work_speed;         /* Скорость выполнения работы, байт/с. */
+  gdouble              bytes_speed;        /* Скорость обработки данных, байт/с. */
+  gdouble              tracks_speed;       /* Скорость обновления галсов, галсов/с. */
 };
 
 static void            hyscan_fix_db_object_constructed      (GObject            *object);
 static void            hyscan_fix_db_object_finalize         (GObject            *object);
 
+static void            hyscan_fix_db_event_free              (gpointer            data);
+
+static void            hyscan_fix_db_notify                  (HyScanFixDB        *fix);
+
+static void            hyscan_fix_db_post_event              (HyScanFixDB        *fix,
+                                                              gboolean            error,
+                                                              gchar              *message);
+
 static void            hyscan_fix_db_set_log_message         (HyScanFixDB        *fix,
                                                               gchar              *log_message);
 
-static gboolean        hyscan_fix_db_alerter                 (gpointer            data);
+static void            hyscan_fix_db_set_error_message       (HyScanFixDB        *fix,
+                                                              gchar              *error_message);
+
+static void            hyscan_fix_db_progress_start          (HyScanFixDB        *fix,
+                                                              HyScanFixPlan      *plan);
+
+static void            hyscan_fix_db_unit_begin              (HyScanFixDB        *fix,
+                                                              HyScanFixPlanUnit  *unit,
+                                                              HyScanCancellable  *cancellable);
+
+static void            hyscan_fix_db_unit_end                (HyScanFixDB        *fix,
+                                                              HyScanFixPlanUnit  *unit,
+                                                              HyScanCancellable  *cancellable);
+
+static void            hyscan_fix_db_unit_result             (HyScanFixDB        *fix,
+                                                              HyScanFixPlanUnit  *unit,
+                                                              gboolean            status);
+
+static void            hyscan_fix_db_report_free             (HyScanFixDBReport  *report);
+
+static void            hyscan_fix_db_emit_progress           (HyScanFixDB        *fix);
+
+static gboolean        hyscan_fix_db_dispatcher              (gpointer            data);
 
 static gpointer        hyscan_fix_db_upgrader                (gpointer            data);
 
+static void            hyscan_fix_db_track_cancel            (GCancellable       *cancellable,
+                                                              gpointer            data);
+
+static gboolean        hyscan_fix_db_rollback                (HyScanFixDB        *fix,
+                                                              const gchar        *unit_path);
+
+static gboolean        hyscan_fix_db_recover                 (HyScanFixDB        *fix,
+                                                              HyScanFixPlan      *plan);
+
+static void            hyscan_fix_db_track_upgrade           (gpointer            data,
+                                                              gpointer            user_data);
+
 static gboolean        hyscan_fix_db_project_upgrade         (HyScanFixDB        *fix,
-                                                              const gchar        *project_name);
+                                                              const gchar        *project_name,
+                                                              GPtrArray          *tracks,
+                                                              HyScanFixPlanUnit  *params);
+
+static gboolean        hyscan_fix_db_execute_plan            (HyScanFixDB        *fix,
+                                                              HyScanFixPlan      *plan);
+
+static void            hyscan_fix_db_start                   (HyScanFixDB        *fix,
+                                                              const gchar        *db_path,
+                                                              HyScanFixPlan      *plan,
+                                                              HyScanCancellable  *cancellable);
 
 static guint           hyscan_fix_db_signals[SIGNAL_LAST] = { 0 };
 
@@ -109,13 +208,43 @@ hyscan_fix_db_class_init (HyScanFixDBClass *klass)
    * @message: информационное сообщение
    *
    * Сигнал посылается для информирования пользователя о
-   * текущем выполняемом действии.
+   * текущем выполняемом действии. Если несколько действий сменились
+   * между сигналами, сообщается только о последнем из них.
    */
   hyscan_fix_db_signals[SIGNAL_LOG] =
       g_signal_new ("log", HYSCAN_TYPE_FIX_DB, G_SIGNAL_RUN_LAST, 0,
                     NULL, NULL,
                     g_cclosure_marshal_VOID__STRING, G_TYPE_NONE, 1, G_TYPE_STRING);
 
+  /**
+   * HyScanFixDB::error:
+   * @fix: указатель на #HyScanFixDB
+   * @message: сообщение об ошибке
+   *
+   * Сигнал посылается при ошибке обновления проекта или галса. В отличие
+   * от сигнала #HyScanFixDB::log, сообщения об ошибках не объединяются и
+   * доставляются все. Каждое сообщение об ошибке также посылается
+   * сигналом #HyScanFixDB::log.
+   */
+  hyscan_fix_db_signals[SIGNAL_ERROR] =
+      g_signal_new ("error", HYSCAN_TYPE_FIX_DB, G_SIGNAL_RUN_LAST, 0,
+                    NULL, NULL,
+                    g_cclosure_marshal_VOID__STRING, G_TYPE_NONE, 1, G_TYPE_STRING);
+
+  /**
+   * HyScanFixDB::progress:
+   * @fix: указатель на #HyScanFixDB
+   * @progress: (type HyScanFixDBProgress): состояние выполнения плана обновления
+   *
+   * Сигнал посылается периодически во время выполнения плана обновления
+   * и один раз после его завершения. Структура @progress действительна
+   * только во время обработки сигнала.
+   */
+  hyscan_fix_db_signals[SIGNAL_PROGRESS] =
+      g_signal_new ("progress", HYSCAN_TYPE_FIX_DB, G_SIGNAL_RUN_LAST, 0,
+                    NULL, NULL,
+                    g_cclosure_marshal_VOID__POINTER, G_TYPE_NONE, 1, G_TYPE_POINTER);
+
   /**
    * HyScanFixDB::completed:
    * @fix: указатель на #HyScanFixDB
@@ -141,9 +270,14 @@ hyscan_fix_db_object_constructed (GObject *object)
   HyScanFixDB *fix = HYSCAN_FIX_DB (object);
   HyScanFixDBPrivate *priv = fix->priv;
 
-  priv->alerter = g_timeout_add (HYSCAN_FIX_DB_INFO_TIMEOUT, hyscan_fix_db_alerter, fix);
+  /* Сигналы посылаются в контексте потока, создавшего объект. */
+  priv->context = g_main_context_ref_thread_default ();
 
   g_mutex_init (&priv->lock);
+  g_mutex_init (&priv->events_lock);
+  g_mutex_init (&priv->progress_lock);
+  g_queue_init (&priv->events);
+  priv->active = g_hash_table_new (g_direct_hash, g_direct_equal);
 }
 
 static void
@@ -152,52 +286,348 @@ hyscan_fix_db_object_finalize (GObject *object)
   HyScanFixDB *fix = HYSCAN_FIX_DB (object);
   HyScanFixDBPrivate *priv = fix->priv;
 
-  if (priv->alerter > 0)
-    g_source_remove (priv->alerter);
-
   hyscan_fix_db_complete (fix);
+  hyscan_fix_db_report_free (priv->report);
+
+  if (priv->dispatcher != NULL)
+    {
+      g_source_destroy (priv->dispatcher);
+      g_source_unref (priv->dispatcher);
+    }
+
+  while (!g_queue_is_empty (&priv->events))
+    hyscan_fix_db_event_free (g_queue_pop_head (&priv->events));
+  g_main_context_unref (priv->context);
+
+  g_hash_table_unref (priv->active);
+  g_mutex_clear (&priv->progress_lock);
+  g_mutex_clear (&priv->events_lock);
   g_mutex_clear (&priv->lock);
 
   G_OBJECT_CLASS (hyscan_fix_db_parent_class)->finalize (object);
 }
 
+/* Функция освобождает сообщение для основного потока. */
+static void
+hyscan_fix_db_event_free (gpointer data)
+{
+  HyScanFixDBEvent *event = data;
+
+  g_free (event->message);
+  g_slice_free (HyScanFixDBEvent, event);
+}
+
+/* Функция планирует доставку изменений в основной контекст, если она
+ * ещё не запланирована. Доставка выполняется не чаще одного раза за
+ * HYSCAN_FIX_DB_INFO_TIMEOUT, в отсутствие изменений источник событий
+ * не создаётся. */
+static void
+hyscan_fix_db_notify (HyScanFixDB *fix)
+{
+  HyScanFixDBPrivate *priv = fix->priv;
+
+  g_mutex_lock (&priv->events_lock);
+
+  if (priv->dispatcher == NULL)
+    {
+      priv->dispatcher = g_timeout_source_new (HYSCAN_FIX_DB_INFO_TIMEOUT);
+      g_source_set_callback (priv->dispatcher, hyscan_fix_db_dispatcher, fix, NULL);
+      g_source_attach (priv->dispatcher, priv->context);
+    }
+
+  g_mutex_unlock (&priv->events_lock);
+}
+
+/* Функция добавляет сообщение в очередь. Информационное сообщение
+ * заменяет ещё не доставленное информационное сообщение в конце очереди,
+ * сообщения об ошибках не заменяются. */
+static void
+hyscan_fix_db_post_event (HyScanFixDB *fix,
+                          gboolean     error,
+                          gchar       *message)
+{
+  HyScanFixDBPrivate *priv = fix->priv;
+  HyScanFixDBEvent *event;
+
+  g_mutex_lock (&priv->events_lock);
+
+  event = g_queue_peek_tail (&priv->events);
+  if (!error && (event != NULL) && !event->error)
+    {
+      g_free (event->message);
+      event->message = message;
+    }
+  else
+    {
+      event = g_slice_new (HyScanFixDBEvent);
+      event->error = error;
+      event->message = message;
+      g_queue_push_tail (&priv->events, event);
+    }
+
+  g_mutex_unlock (&priv->events_lock);
+
+  hyscan_fix_db_notify (fix);
+}
+
 /* Функция устанавливает сообщение с описанием текущего действия. */
 static void
 hyscan_fix_db_set_log_message (HyScanFixDB *fix,
                                gchar       *log_message)
+{
+  hyscan_fix_db_post_event (fix, FALSE, log_message);
+}
+
+/* Функция добавляет сообщение об ошибке. */
+static void
+hyscan_fix_db_set_error_message (HyScanFixDB *fix,
+                                 gchar       *error_message)
+{
+  hyscan_fix_db_post_event (fix, TRUE, error_message);
+}
+
+/* Функция подготавливает учёт выполнения плана обновления. Объём работы
+ * каждого объекта берётся из оценки затрат, сделанной при сканировании. */
+static void
+hyscan_fix_db_progress_start (HyScanFixDB   *fix,
+                              HyScanFixPlan *plan)
 {
   HyScanFixDBPrivate *priv = fix->priv;
-  gchar *old_message = g_atomic_pointer_get (&priv->log_message);
+  guint i;
+
+  g_mutex_lock (&priv->progress_lock);
+
+  memset (&priv->progress, 0, sizeof (priv->progress));
+  priv->total_work = 0;
+  priv->done_work = 0;
+
+  for (i = 0; i < plan->units->len; i++)
+    {
+      HyScanFixPlanUnit *unit = plan->units->pdata[i];
+
+      priv->total_work += hyscan_fix_plan_unit_get_work (unit);
+      priv->progress.total_bytes += unit->cost.read_bytes + unit->cost.write_bytes;
+      if (unit->track != NULL)
+        priv->progress.n_tracks += 1;
+    }
+
+  priv->report->n_units = plan->units->len;
+
+  priv->restart = TRUE;
+  g_atomic_int_set (&priv->running, TRUE);
+
+  g_mutex_unlock (&priv->progress_lock);
+
+  hyscan_fix_db_notify (fix);
+}
 
-  if (g_atomic_pointer_compare_and_exchange (&priv->log_message, old_message, log_message))
-    g_free (old_message);
-  else if (g_atomic_pointer_get (&priv->log_message) == NULL)
-    g_atomic_pointer_set (&priv->log_message, log_message);
+/* Функция регистрирует начало обновления галса. До завершения обновления
+ * выполненная часть работы определяется по прогрессу cancellable. */
+static void
+hyscan_fix_db_unit_begin (HyScanFixDB       *fix,
+                          HyScanFixPlanUnit *unit,
+                          HyScanCancellable *cancellable)
+{
+  HyScanFixDBPrivate *priv = fix->priv;
+
+  g_mutex_lock (&priv->progress_lock);
+  g_hash_table_insert (priv->active, cancellable, unit);
+  g_mutex_unlock (&priv->progress_lock);
+}
+
+/* Функция учитывает работу по завершённому, пропущенному или
+ * отменённому объекту обновления. */
+static void
+hyscan_fix_db_unit_end (HyScanFixDB       *fix,
+                        HyScanFixPlanUnit *unit,
+                        HyScanCancellable *cancellable)
+{
+  HyScanFixDBPrivate *priv = fix->priv;
+
+  g_mutex_lock (&priv->progress_lock);
+
+  if (cancellable != NULL)
+    g_hash_table_remove (priv->active, cancellable);
+
+  priv->done_work += hyscan_fix_plan_unit_get_work (unit);
+  priv->progress.done_bytes += unit->cost.read_bytes + unit->cost.write_bytes;
+  if (unit->track != NULL)
+    priv->progress.n_done += 1;
+
+  hyscan_cancellable_set_total (priv->cancellable, priv->done_work, 0, MAX (priv->total_work, 1));
+
+  g_mutex_unlock (&priv->progress_lock);
+}
+
+/* Функция учитывает результат обновления объекта в отчёте. Объекты,
+ * обновление которых не выполнялось, в отчёте не учитываются. */
+static void
+hyscan_fix_db_unit_result (HyScanFixDB       *fix,
+                           HyScanFixPlanUnit *unit,
+                           gboolean           status)
+{
+  HyScanFixDBPrivate *priv = fix->priv;
+
+  g_mutex_lock (&priv->progress_lock);
+
+  if (status)
+    {
+      priv->report->n_updated += 1;
+    }
   else
-    g_free (log_message);
+    {
+      priv->report->n_failed += 1;
+      hyscan_fix_plan_add (priv->report->failed, unit);
+    }
+
+  g_mutex_unlock (&priv->progress_lock);
 }
 
-/* Функция сигнализатор об изменениях в состоянии процесса обновления. */
+/* Функция освобождает отчёт о выполнении плана обновления. */
+static void
+hyscan_fix_db_report_free (HyScanFixDBReport *report)
+{
+  if (report == NULL)
+    return;
+
+  hyscan_fix_plan_free (report->failed);
+  g_slice_free (HyScanFixDBReport, report);
+}
+
+/* Функция рассчитывает состояние выполнения плана обновления и посылает
+ * сигнал "progress". Скорость обновления измеряется на интервалах
+ * HYSCAN_FIX_DB_RATE_PERIOD и сглаживается, оставшееся время оценивается
+ * по скорости выполнения работы. Вызывается только из основного потока. */
+static void
+hyscan_fix_db_emit_progress (HyScanFixDB *fix)
+{
+  HyScanFixDBPrivate *priv = fix->priv;
+  HyScanFixDBProgress progress;
+  GHashTableIter iter;
+  gpointer key, value;
+  guint64 total_work;
+  gdouble work, bytes;
+  gboolean restart;
+  gint64 now;
+
+  g_mutex_lock (&priv->progress_lock);
+
+  progress = priv->progress;
+  total_work = priv->total_work;
+  work = priv->done_work;
+  bytes = priv->progress.done_bytes;
+
+  /* Выполненная часть работы по обновляемым галсам. */
+  g_hash_table_iter_init (&iter, priv->active);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      HyScanFixPlanUnit *unit = value;
+      gdouble fraction;
+
+      fraction = CLAMP (hyscan_cancellable_get (key), 0.0, 1.0);
+      work += fraction * hyscan_fix_plan_unit_get_work (unit);
+      bytes += fraction * (unit->cost.read_bytes + unit->cost.write_bytes);
+    }
+
+  restart = priv->restart;
+  priv->restart = FALSE;
+
+  g_mutex_unlock (&priv->progress_lock);
+
+  now = g_get_monotonic_time ();
+  if (restart)
+    {
+      priv->rate_time = now;
+      priv->rate_work = work;
+      priv->rate_bytes = bytes;
+      priv->rate_tracks = progress.n_done;
+      priv->rate_valid = FALSE;
+    }
+
+  if (now - priv->rate_time >= HYSCAN_FIX_DB_RATE_PERIOD)
+    {
+      gdouble period = (gdouble)(now - priv->rate_time) / G_TIME_SPAN_SECOND;
+      gdouble work_speed = (work - priv->rate_work) / period;
+      gdouble bytes_speed = (bytes - priv->rate_bytes) / period;
+      gdouble tracks_speed = (progress.n_done - priv->rate_tracks) / period;
+
+      if (priv->rate_valid)
+        {
+          work_speed = (priv->work_speed + work_speed) / 2.0;
+          bytes_speed = (priv->bytes_speed + bytes_speed) / 2.0;
+          tracks_speed = (priv->tracks_speed + tracks_speed) / 2.0;
+        }
+
+      priv->work_speed = work_speed;
+      priv->bytes_speed = bytes_speed;
+      priv->tracks_speed = tracks_speed;
+      priv->rate_valid = TRUE;
+
+      priv->rate_time = now;
+      priv->rate_work = work;
+      priv->rate_bytes = bytes;
+      priv->rate_tracks = progress.n_done;
+    }
+
+  progress.progress = (total_work > 0) ? MIN (work / total_work, 1.0) : 1.0;
+  progress.done_bytes = bytes;
+  progress.bytes_rate = priv->bytes_speed / (1024.0 * 1024.0);
+  progress.tracks_rate = priv->tracks_speed;
+  progress.eta = -1;
+
+  if (priv->rate_valid && (priv->work_speed > 0.0))
+    progress.eta = MAX (total_work - work, 0.0) / priv->work_speed + 0.5;
+
+  g_signal_emit (fix, hyscan_fix_db_signals[SIGNAL_PROGRESS], 0, &progress);
+}
+
+/* Функция доставляет изменения в состоянии процесса обновления в основной
+ * контекст. Пока выполняется план обновления, функция вызывается
+ * периодически для сообщения о прогрессе, иначе источник удаляется до
+ * появления новых изменений. */
 static gboolean
-hyscan_fix_db_alerter (gpointer data)
+hyscan_fix_db_dispatcher (gpointer data)
 {
   HyScanFixDB *fix  = data;
   HyScanFixDBPrivate *priv = fix->priv;
-  gchar *log_message;
+  gboolean running;
+  gboolean completed;
+  GQueue events;
+
+  g_mutex_lock (&priv->events_lock);
+
+  events = priv->events;
+  g_queue_init (&priv->events);
+
+  running = g_atomic_int_get (&priv->running);
+  completed = g_atomic_int_compare_and_exchange (&priv->completed, TRUE, FALSE);
+
+  /* Источник удаляется под блокировкой, поэтому изменения, появившиеся
+   * после этого, запланируют новую доставку. */
+  if (!running)
+    g_clear_pointer (&priv->dispatcher, g_source_unref);
+
+  g_mutex_unlock (&priv->events_lock);
 
-  log_message = g_atomic_pointer_get (&priv->log_message);
-  if (log_message != NULL)
+  while (!g_queue_is_empty (&events))
     {
-      g_atomic_pointer_set (&priv->log_message, NULL);
-      g_signal_emit (fix, hyscan_fix_db_signals[SIGNAL_LOG], 0, log_message);
-      g_free (log_message);
+      HyScanFixDBEvent *event = g_queue_pop_head (&events);
+
+      if (event->error)
+        g_signal_emit (fix, hyscan_fix_db_signals[SIGNAL_ERROR], 0, event->message);
+      g_signal_emit (fix, hyscan_fix_db_signals[SIGNAL_LOG], 0, event->message);
+
+      hyscan_fix_db_event_free (event);
     }
 
+  if (running || completed)
+    hyscan_fix_db_emit_progress (fix);
+
   /* Сигнал о завершении обновления. */
-  if (g_atomic_int_compare_and_exchange (&priv->completed, TRUE, FALSE))
+  if (completed)
     g_signal_emit (fix, hyscan_fix_db_signals[SIGNAL_COMPLETED], 0, priv->status);
 
-  return TRUE;
+  return running ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
 }
 
 /* Поток обновления базы данных. */
@@ -206,15 +636,13 @@ hyscan_fix_db_upgrader (gpointer data)
 {
   HyScanFixDB *fix  = data;
   HyScanFixDBPrivate *priv = fix->priv;
+  gboolean full_scan = FALSE;
+  gboolean checkpoint = FALSE;
   gboolean status = FALSE;
 
   HyScanDB *db_lock;
   gchar *db_uri;
 
-  gchar **projects;
-  guint n_projects;
-  guint i;
-
   db_uri = g_strdup_printf ("file://%s", priv->db_path);
   db_lock = hyscan_db_new (db_uri);
   g_free (db_uri);
@@ -222,120 +650,424 @@ hyscan_fix_db_upgrader (gpointer data)
   if (db_lock == NULL)
     goto exit;
 
-  projects = hyscan_fix_dir_list (priv->db_path);
-  if (projects == NULL)
+  /* Объекты, обновлённые до прерывания предыдущего запуска, пропускаются.
+   * Журнал не открывается, если эта база данных уже обновляется. В этом
+   * случае журналы обновления не затрагиваются. */
+  if (!hyscan_fix_checkpoint_open (priv->db_path))
     goto exit;
+  checkpoint = TRUE;
 
-  status = TRUE;
-  n_projects = g_strv_length (projects);
-  hyscan_cancellable_push (priv->cancellable);
+  hyscan_fix_cache_load (priv->db_path);
 
-  for (i = 0; i < n_projects; i++)
+  /* При сканировании прерванные обновления проектов и галсов попадают
+   * в план и откатываются при его выполнении, поэтому здесь откатываются
+   * только изменения в корне базы данных. Готовый план может быть частью
+   * общего плана, остальные части которого выполняются одновременно,
+   * поэтому перед его выполнением откатываются изменения только его
+   * объектов. */
+  if (priv->plan != NULL)
     {
-      hyscan_cancellable_set_total (priv->cancellable, i, 0, n_projects);
+      if (!hyscan_fix_db_recover (fix, priv->plan))
+        goto exit;
+    }
+  else if (hyscan_fix_journal_exist (priv->db_path) && !hyscan_fix_revert (priv->db_path))
+    {
+      goto exit;
+    }
 
-      if (g_cancellable_is_cancelled (G_CANCELLABLE (priv->cancellable)))
-        break;
+  /* Составляем план обновления, если он не задан. */
+  if (priv->plan == NULL)
+    {
+      full_scan = TRUE;
+      hyscan_fix_db_set_log_message (fix, g_strdup (_("Scanning database")));
 
-      status = hyscan_fix_db_project_upgrade (fix, projects[i]);
-      if (!status)
-        break;
+      priv->plan = hyscan_fix_plan_scan (priv->db_path, g_atomic_int_get (&priv->n_threads), priv->cancellable);
+      if (priv->plan == NULL)
+        goto exit;
     }
 
-  hyscan_cancellable_pop (priv->cancellable);
-  g_strfreev (projects);
+  status = hyscan_fix_db_execute_plan (fix, priv->plan);
 
 exit:
+  hyscan_fix_journal_close (priv->db_path);
+
+  /* Журнал завершённых объектов больше не нужен, если вся база данных
+   * обновлена. При выполнении готового плана, который может быть частью
+   * общего плана, журнал сохраняется. */
+  if (checkpoint)
+    {
+      hyscan_fix_checkpoint_close (priv->db_path, status && full_scan &&
+                                   !g_cancellable_is_cancelled (G_CANCELLABLE (priv->cancellable)));
+
+      /* Кэш контрольных сумм загружается и сохраняется только
+       * обновлением, открывшим журнал этой базы данных. */
+      hyscan_fix_cache_save (priv->db_path);
+      hyscan_fix_cache_clear (priv->db_path);
+    }
+
   g_clear_object (&db_lock);
   g_clear_object (&priv->cancellable);
+  g_clear_pointer (&priv->plan, hyscan_fix_plan_free);
   g_clear_pointer (&priv->db_path, g_free);
 
+  g_mutex_lock (&priv->progress_lock);
+  priv->report->n_skipped = priv->report->n_units - priv->report->n_updated - priv->report->n_failed;
+  g_mutex_unlock (&priv->progress_lock);
+
   priv->status = status;
+  g_atomic_int_set (&priv->running, FALSE);
   g_atomic_int_set (&priv->completed, TRUE);
+  hyscan_fix_db_notify (fix);
 
   return NULL;
 }
 
-/* Функция обновляет проект и все галсы в нём. */
+/* Функция отменяет обновление галса при отмене обновления базы данных. */
+static void
+hyscan_fix_db_track_cancel (GCancellable *cancellable,
+                            gpointer      data)
+{
+  g_cancellable_cancel (G_CANCELLABLE (data));
+}
+
+/* Функция откатывает изменения проекта или галса по его журналам. */
+static gboolean
+hyscan_fix_db_rollback (HyScanFixDB *fix,
+                        const gchar *unit_path)
+{
+  HyScanFixDBPrivate *priv = fix->priv;
+  gboolean status;
+  gchar *unit_root;
+
+  unit_root = g_build_filename (priv->db_path, unit_path, NULL);
+  status = hyscan_fix_revert (unit_root);
+  hyscan_fix_journal_close (unit_root);
+  g_free (unit_root);
+
+  return status;
+}
+
+/* Функция откатывает прерванные изменения в корне базы данных и в
+ * каталогах объектов плана обновления. */
 static gboolean
-hyscan_fix_db_project_upgrade (HyScanFixDB *fix,
-                               const gchar *project_name)
+hyscan_fix_db_recover (HyScanFixDB   *fix,
+                       HyScanFixPlan *plan)
 {
   HyScanFixDBPrivate *priv = fix->priv;
   gboolean status = TRUE;
-  gchar *log_message;
-  gchar *project_path;
-  gchar **tracks;
-  guint n_tracks;
-  gint version;
   guint i;
 
-  version = hyscan_fix_project_get_version (priv->db_path, project_name);
-  if (version == HYSCAN_FIX_PROJECT_NOT_PROJECT)
-    return TRUE;
+  if (hyscan_fix_journal_exist (priv->db_path) && !hyscan_fix_revert (priv->db_path))
+    return FALSE;
 
-  log_message = g_strdup_printf (_("Update project %s"), project_name);
-  hyscan_fix_db_set_log_message (fix, log_message);
+  for (i = 0; status && (i < plan->units->len); i++)
+    {
+      HyScanFixPlanUnit *unit = plan->units->pdata[i];
+      gchar *unit_path;
+      gchar *unit_root;
 
-  project_path = g_build_filename (priv->db_path, project_name, NULL);
-  tracks = hyscan_fix_dir_list (project_path);
-  g_free (project_path);
+      unit_path = g_build_filename (unit->project, unit->track, NULL);
+      unit_root = g_build_filename (priv->db_path, unit_path, NULL);
 
-  if (tracks == NULL)
-    return FALSE;
+      if (hyscan_fix_journal_exist (unit_root))
+        status = hyscan_fix_db_rollback (fix, unit_path);
 
-  n_tracks = g_strv_length (tracks);
-  hyscan_cancellable_push (priv->cancellable);
+      g_free (unit_root);
+      g_free (unit_path);
+    }
 
-  for (i = 0; i < n_tracks; i++)
+  return status;
+}
+
+/* Функция сообщает о неизвестной версии формата данных вместе с
+ * контрольной суммой схемы. */
+static void
+hyscan_fix_db_unknown_version (HyScanFixDB *fix,
+                               const gchar *unit_path,
+                               const gchar *sch_name)
+{
+  gchar *sch_file;
+  gchar *sch_md5;
+
+  sch_file = g_build_filename (unit_path, sch_name, NULL);
+  sch_md5 = hyscan_fix_file_md5 (fix->priv->db_path, sch_file);
+  if (sch_md5 != NULL)
     {
-      gchar *track_path;
+      hyscan_fix_db_set_error_message (fix, g_strdup_printf (_("Unknown version of %s - %s"),
+                                                             unit_path, sch_md5));
+    }
 
-      hyscan_cancellable_set_total (priv->cancellable, i, 0, n_tracks);
+  g_free (sch_file);
+  g_free (sch_md5);
+}
 
-      if (g_cancellable_is_cancelled (G_CANCELLABLE (priv->cancellable)))
-        break;
+/* Функция обновляет галс проекта. Вызывается из потоков обновления галсов. */
+static void
+hyscan_fix_db_track_upgrade (gpointer data,
+                             gpointer user_data)
+{
+  HyScanFixPlanUnit *unit = data;
+  HyScanFixDBProject *project = user_data;
+  HyScanFixDB *fix = project->fix;
+  HyScanFixDBPrivate *priv = fix->priv;
+  HyScanCancellable *cancellable = NULL;
+  gchar *log_message;
+  gchar *track_path;
+  gulong handler = 0;
+  gboolean status = TRUE;
 
-      track_path = g_build_filename (project_name, tracks[i], NULL);
-      version = hyscan_fix_track_get_version (priv->db_path, track_path);
-      if ((version != HYSCAN_FIX_TRACK_NOT_TRACK) &&
-          (version != HYSCAN_FIX_TRACK_LATEST))
-        {
-          log_message = g_strdup_printf (_("Updating track %s.%s"), project_name, tracks[i]);
-          hyscan_fix_db_set_log_message (fix, log_message);
+  track_path = g_build_filename (project->project_name, unit->track, NULL);
 
-          status = hyscan_fix_track (priv->db_path, track_path, priv->cancellable);
-        }
-      g_free (track_path);
+  /* Обновление прекращается при отмене или, если не задано продолжение
+   * после ошибок, при ошибке в другом галсе. */
+  if (g_cancellable_is_cancelled (G_CANCELLABLE (priv->cancellable)) ||
+      (!g_atomic_int_get (&project->status) && !g_atomic_int_get (&priv->keep_going)))
+    {
+      goto exit;
+    }
 
-      if (!status)
-        {
-          log_message = g_strdup_printf (_("Failed to update %s.%s"), project_name, tracks[i]);
-          hyscan_fix_db_set_log_message (fix, log_message);
+  /* Галс обновлён до прерывания предыдущего запуска. */
+  if (hyscan_fix_checkpoint_contains (priv->db_path, project->project_name, unit->track))
+    {
+      hyscan_fix_db_unit_result (fix, unit, TRUE);
+      goto exit;
+    }
+
+  log_message = g_strdup_printf (_("Updating track %s.%s"), project->project_name, unit->track);
+  hyscan_fix_db_set_log_message (fix, log_message);
 
-          break;
+  /* Стек прогресса HyScanCancellable не рассчитан на параллельное
+   * использование, поэтому каждый галс обновляется со своим объектом,
+   * отменяемым вместе с основным. */
+  cancellable = hyscan_cancellable_new ();
+  handler = g_cancellable_connect (G_CANCELLABLE (priv->cancellable),
+                                   G_CALLBACK (hyscan_fix_db_track_cancel),
+                                   cancellable, NULL);
+  hyscan_fix_db_unit_begin (fix, unit, cancellable);
+
+  status = hyscan_fix_track (priv->db_path, track_path, cancellable);
+  if (status)
+    {
+      hyscan_fix_checkpoint_commit (priv->db_path, project->project_name, unit->track);
+      hyscan_fix_db_unit_result (fix, unit, TRUE);
+    }
+  else
+    {
+      g_atomic_int_set (&project->status, FALSE);
+
+      /* Отменённое обновление не является ошибкой, изменения галса
+       * будут отменены по журналам при следующем запуске. */
+      if (!g_cancellable_is_cancelled (G_CANCELLABLE (cancellable)))
+        {
+          log_message = g_strdup_printf (_("Failed to update %s.%s"), project->project_name, unit->track);
+          hyscan_fix_db_set_error_message (fix, log_message);
+          if (hyscan_fix_track_probe_version (priv->db_path, track_path) == HYSCAN_FIX_TRACK_UNKNOWN)
+            hyscan_fix_db_unknown_version (fix, track_path, "track.sch");
+          hyscan_fix_db_unit_result (fix, unit, FALSE);
+
+          /* При продолжении после ошибок галс сразу возвращается
+           * в исходное состояние. */
+          if (g_atomic_int_get (&priv->keep_going) && !hyscan_fix_db_rollback (fix, track_path))
+            {
+              log_message = g_strdup_printf (_("Failed to roll back %s.%s"), project->project_name, unit->track);
+              hyscan_fix_db_set_error_message (fix, log_message);
+            }
         }
     }
 
-  if (status)
+exit:
+  hyscan_fix_db_unit_end (fix, unit, cancellable);
+
+  if (handler > 0)
+    g_cancellable_disconnect (G_CANCELLABLE (priv->cancellable), handler);
+
+  g_clear_object (&cancellable);
+  g_free (track_path);
+}
+
+/* Функция обновляет галсы проекта и, если требуется, его параметры.
+ * Параметры проекта обновляются только после успешного обновления
+ * всех его галсов. */
+static gboolean
+hyscan_fix_db_project_upgrade (HyScanFixDB       *fix,
+                               const gchar       *project_name,
+                               GPtrArray         *tracks,
+                               HyScanFixPlanUnit *params)
+{
+  HyScanFixDBPrivate *priv = fix->priv;
+  HyScanFixDBProject project;
+  GThreadPool *pool;
+  gboolean status;
+  gchar *log_message;
+  guint n_threads;
+  guint i;
+
+  log_message = g_strdup_printf (_("Update project %s"), project_name);
+  hyscan_fix_db_set_log_message (fix, log_message);
+
+  project.fix = fix;
+  project.project_name = project_name;
+  project.status = TRUE;
+
+  n_threads = g_atomic_int_get (&priv->n_threads);
+  if (n_threads == 0)
+    n_threads = g_get_num_processors ();
+
+  /* Галсы независимы друг от друга и обновляются параллельно. */
+  pool = g_thread_pool_new (hyscan_fix_db_track_upgrade, &project, n_threads, FALSE, NULL);
+  for (i = 0; i < tracks->len; i++)
+    g_thread_pool_push (pool, tracks->pdata[i], NULL);
+  g_thread_pool_free (pool, FALSE, TRUE);
+
+  status = project.status;
+
+  if ((params == NULL) || g_cancellable_is_cancelled (G_CANCELLABLE (priv->cancellable)))
+    {
+      /* Параметры проекта не обновляются. */
+    }
+  else if (!status)
+    {
+      /* При продолжении после ошибок параметры проекта с ошибками в
+       * галсах учитываются в отчёте как необновлённые. */
+      if (g_atomic_int_get (&priv->keep_going))
+        {
+          log_message = g_strdup_printf (_("Parameters %s not updated due to track errors"), project_name);
+          hyscan_fix_db_set_error_message (fix, log_message);
+          hyscan_fix_db_unit_result (fix, params, FALSE);
+        }
+    }
+  else if (hyscan_fix_checkpoint_contains (priv->db_path, project_name, NULL))
+    {
+      hyscan_fix_db_unit_result (fix, params, TRUE);
+    }
+  else
     {
       log_message = g_strdup_printf (_("Updating parameters %s"), project_name);
       hyscan_fix_db_set_log_message (fix, log_message);
 
       status = hyscan_fix_project (priv->db_path, project_name);
-      if (!status)
+      if (status)
+        {
+          hyscan_fix_checkpoint_commit (priv->db_path, project_name, NULL);
+        }
+      else
         {
           log_message = g_strdup_printf (_("Failed to update parameters %s"), project_name);
-          hyscan_fix_db_set_log_message (fix, log_message);
+          hyscan_fix_db_set_error_message (fix, log_message);
+          if (hyscan_fix_project_probe_version (priv->db_path, project_name) == HYSCAN_FIX_PROJECT_UNKNOWN)
+            hyscan_fix_db_unknown_version (fix, project_name, "project.prm" G_DIR_SEPARATOR_S "project.sch");
+
+          if (g_atomic_int_get (&priv->keep_going) && !hyscan_fix_db_rollback (fix, project_name))
+            {
+              log_message = g_strdup_printf (_("Failed to roll back parameters %s"), project_name);
+              hyscan_fix_db_set_error_message (fix, log_message);
+            }
         }
+
+      hyscan_fix_db_unit_result (fix, params, status);
     }
 
-  hyscan_cancellable_pop (priv->cancellable);
-  g_strfreev (tracks);
+  if (params != NULL)
+    hyscan_fix_db_unit_end (fix, params, NULL);
 
   return status;
 }
 
+/* Функция выполняет план обновления. Объекты плана группируются по
+ * проектам в порядке их появления в плане. */
+static gboolean
+hyscan_fix_db_execute_plan (HyScanFixDB   *fix,
+                            HyScanFixPlan *plan)
+{
+  HyScanFixDBPrivate *priv = fix->priv;
+  GHashTable *projects;
+  GHashTable *params;
+  GPtrArray *order;
+  gboolean status = TRUE;
+  guint i;
+
+  projects = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify)g_ptr_array_unref);
+  params = g_hash_table_new (g_str_hash, g_str_equal);
+  order = g_ptr_array_new ();
+
+  for (i = 0; i < plan->units->len; i++)
+    {
+      HyScanFixPlanUnit *unit = plan->units->pdata[i];
+      GPtrArray *tracks;
+
+      tracks = g_hash_table_lookup (projects, unit->project);
+      if (tracks == NULL)
+        {
+          tracks = g_ptr_array_new ();
+          g_hash_table_insert (projects, unit->project, tracks);
+          g_ptr_array_add (order, unit->project);
+        }
+
+      if (unit->track != NULL)
+        g_ptr_array_add (tracks, unit);
+      else
+        g_hash_table_insert (params, unit->project, unit);
+    }
+
+  /* Прогресс рассчитывается по объёму работы, а не по числу объектов. */
+  hyscan_fix_db_progress_start (fix, plan);
+
+  /* При продолжении после ошибок проекты с ошибками пропускаются,
+   * но общий статус обновления остаётся ошибочным. */
+  for (i = 0; i < order->len; i++)
+    {
+      const gchar *project_name = order->pdata[i];
+
+      if (g_cancellable_is_cancelled (G_CANCELLABLE (priv->cancellable)))
+        break;
+
+      if (!hyscan_fix_db_project_upgrade (fix, project_name,
+                                          g_hash_table_lookup (projects, project_name),
+                                          g_hash_table_lookup (params, project_name)))
+        {
+          status = FALSE;
+          if (!g_atomic_int_get (&priv->keep_going))
+            break;
+        }
+    }
+
+  g_ptr_array_unref (order);
+  g_hash_table_unref (params);
+  g_hash_table_unref (projects);
+
+  return status;
+}
+
+/* Функция запускает поток обновления базы данных. */
+static void
+hyscan_fix_db_start (HyScanFixDB       *fix,
+                     const gchar       *db_path,
+                     HyScanFixPlan     *plan,
+                     HyScanCancellable *cancellable)
+{
+  HyScanFixDBPrivate *priv = fix->priv;
+
+  g_mutex_lock (&priv->lock);
+
+  if (priv->upgrader == NULL)
+    {
+      hyscan_fix_db_report_free (priv->report);
+      priv->report = g_slice_new0 (HyScanFixDBReport);
+      priv->report->failed = hyscan_fix_plan_new (db_path);
+
+      priv->db_path = g_strdup (db_path);
+      priv->plan = plan;
+      priv->cancellable = g_object_ref (cancellable);
+      priv->upgrader = g_thread_new ("db-upgrader", hyscan_fix_db_upgrader, fix);
+    }
+  else
+    {
+      hyscan_fix_plan_free (plan);
+    }
+
+  g_mutex_unlock (&priv->lock);
+}
+
 /**
  * hyscan_fix_db_new:
  *
@@ -349,35 +1081,99 @@ hyscan_fix_db_new (void)
   return g_object_new (HYSCAN_TYPE_FIX_DB, NULL);
 }
 
+/**
+ * hyscan_fix_db_set_threads:
+ * @fix: указатель на #HyScanFixDB
+ * @n_threads: число потоков обновления галсов
+ *
+ * Функция задаёт число галсов, обновляемых параллельно. Значение 0
+ * соответствует числу процессоров в системе и используется по умолчанию.
+ * Изменение вступает в силу при обновлении следующего проекта.
+ */
+void
+hyscan_fix_db_set_threads (HyScanFixDB *fix,
+                           guint        n_threads)
+{
+  g_return_if_fail (HYSCAN_IS_FIX_DB (fix));
+
+  g_atomic_int_set (&fix->priv->n_threads, n_threads);
+}
+
+/**
+ * hyscan_fix_db_set_keep_going:
+ * @fix: указатель на #HyScanFixDB
+ * @keep_going: признак продолжения обновления после ошибок
+ *
+ * Функция включает режим продолжения обновления после ошибок. В этом
+ * режиме изменения проекта или галса, обновление которого завершилось
+ * ошибкой, сразу откатываются, объект учитывается в отчёте, а обновление
+ * остальных объектов продолжается. Параметры проекта обновляются только
+ * при успешном обновлении всех его галсов. По умолчанию обновление
+ * прекращается при первой ошибке.
+ */
+void
+hyscan_fix_db_set_keep_going (HyScanFixDB *fix,
+                              gboolean     keep_going)
+{
+  g_return_if_fail (HYSCAN_IS_FIX_DB (fix));
+
+  g_atomic_int_set (&fix->priv->keep_going, keep_going);
+}
+
+/**
+ * hyscan_fix_db_set_flush_mode:
+ * @mode: режим сброса журналов на диск
+ *
+ * Функция задаёт режим сброса журналов обновления на диск. Режим общий
+ * для всего процесса: он действует на все объекты #HyScanFixDB и на все
+ * обновляемые базы данных, в том числе на уже запущенные обновления.
+ * По умолчанию используется режим %HYSCAN_FIX_FLUSH_COMMIT.
+ */
+void
+hyscan_fix_db_set_flush_mode (HyScanFixFlushMode mode)
+{
+  hyscan_fix_journal_set_mode (mode);
+}
+
 /**
  * hyscan_fix_db_upgrade:
  * @fix: указатель на #HyScanFixDB
  * @db_path: путь к базе данных
  * @cancellable: указатель на #HyScanCancellable
  *
- * Функция запускает поток обновления базы данных.
+ * Функция запускает поток обновления базы данных. Сначала составляется
+ * план обновления, затем он выполняется.
  */
 void
 hyscan_fix_db_upgrade (HyScanFixDB       *fix,
                        const gchar       *db_path,
                        HyScanCancellable *cancellable)
 {
-  HyScanFixDBPrivate *priv;
-
   g_return_if_fail (HYSCAN_IS_FIX_DB (fix));
 
-  priv = fix->priv;
-
-  g_mutex_lock (&priv->lock);
+  hyscan_fix_db_start (fix, db_path, NULL, cancellable);
+}
 
-  if (priv->upgrader == NULL)
-    {
-      priv->db_path = g_strdup (db_path);
-      priv->cancellable = g_object_ref (cancellable);
-      priv->upgrader = g_thread_new ("db-upgrader", hyscan_fix_db_upgrader, fix);
-    }
+/**
+ * hyscan_fix_db_execute:
+ * @fix: указатель на #HyScanFixDB
+ * @plan: (transfer full): план обновления
+ * @cancellable: указатель на #HyScanCancellable
+ *
+ * Функция запускает поток выполнения готового плана обновления базы данных.
+ * База данных при этом повторно не сканируется. Объекты плана, обновлённые
+ * ранее, пропускаются, поэтому прерванное выполнение плана можно продолжить,
+ * запустив его повторно.
+ */
+void
+hyscan_fix_db_execute (HyScanFixDB       *fix,
+                       HyScanFixPlan     *plan,
+                       HyScanCancellable *cancellable)
+{
+  g_return_if_fail (HYSCAN_IS_FIX_DB (fix));
+  g_return_if_fail (plan != NULL);
 
-  g_mutex_unlock (&priv->lock);
+  hyscan_fix_db_start (fix, plan->db_path, plan, cancellable);
 }
 
 /**
@@ -409,3 +1205,25 @@ hyscan_fix_db_complete (HyScanFixDB *fix)
 
   return status;
 }
+
+/**
+ * hyscan_fix_db_get_report:
+ * @fix: указатель на #HyScanFixDB
+ *
+ * Функция возвращает отчёт о последнем обновлении базы данных: число
+ * обновлённых объектов, объектов с ошибками и необработанных объектов,
+ * а также план обновления из объектов с ошибками, который можно сохранить
+ * функцией #hyscan_fix_plan_save для повторной попытки. Функцию следует
+ * вызывать после завершения обновления.
+ *
+ * Returns: (transfer none) (nullable): Отчёт о выполнении плана обновления
+ * или NULL, если обновление не запускалось. Отчёт действителен до запуска
+ * следующего обновления.
+ */
+const HyScanFixDBReport *
+hyscan_fix_db_get_report (HyScanFixDB *fix)
+{
+  g_return_val_if_fail (HYSCAN_IS_FIX_DB (fix), NULL);
+
+  return fix->priv->report;
+}
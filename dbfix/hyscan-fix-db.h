@@ -36,6 +36,7 @@
 #define __HYSCAN_FIX_DB_H__
 
 #include <hyscan-cancellable.h>
+#include "hyscan-fix-plan.h"
 
 G_BEGIN_DECLS
 
@@ -46,6 +47,55 @@ G_BEGIN_DECLS
 #define HYSCAN_IS_FIX_DB_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE ((klass), HYSCAN_TYPE_FIX_DB))
 #define HYSCAN_FIX_DB_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS ((obj), HYSCAN_TYPE_FIX_DB, HyScanFixDBClass))
 
+/**
+ * HyScanFixDBProgress:
+ * @progress: доля выполненной работы, от 0 до 1
+ * @done_bytes: объём обработанных данных, байт
+ * @total_bytes: общий объём обрабатываемых данных, байт
+ * @n_done: число обработанных галсов
+ * @n_tracks: общее число обновляемых галсов
+ * @bytes_rate: скорость обработки данных, МБ/с
+ * @tracks_rate: скорость обновления галсов, галсов/с
+ * @eta: оценка оставшегося времени, секунды, или -1 если она неизвестна
+ *
+ * Состояние выполнения плана обновления. Доля выполненной работы
+ * рассчитывается по оценке объёма данных каждого объекта обновления,
+ * с учётом галсов, обновление которых ещё не завершено.
+ */
+typedef struct _HyScanFixDBProgress HyScanFixDBProgress;
+struct _HyScanFixDBProgress
+{
+  gdouble              progress;
+  guint64              done_bytes;
+  guint64              total_bytes;
+  guint                n_done;
+  guint                n_tracks;
+  gdouble              bytes_rate;
+  gdouble              tracks_rate;
+  gint64               eta;
+};
+
+/**
+ * HyScanFixDBReport:
+ * @n_units: число объектов в плане обновления
+ * @n_updated: число обновлённых объектов
+ * @n_failed: число объектов, обновление которых завершилось ошибкой
+ * @n_skipped: число объектов, обновление которых не выполнялось из-за
+ *   отмены или ошибки
+ * @failed: план обновления, составленный из объектов с ошибками
+ *
+ * Отчёт о выполнении плана обновления.
+ */
+typedef struct _HyScanFixDBReport HyScanFixDBReport;
+struct _HyScanFixDBReport
+{
+  guint                n_units;
+  guint                n_updated;
+  guint                n_failed;
+  guint                n_skipped;
+  HyScanFixPlan       *failed;
+};
+
 typedef struct _HyScanFixDB HyScanFixDB;
 typedef struct _HyScanFixDBPrivate HyScanFixDBPrivate;
 typedef struct _HyScanFixDBClass HyScanFixDBClass;
@@ -66,12 +116,28 @@ GType                  hyscan_fix_db_get_type         (void);
 
 HyScanFixDB *          hyscan_fix_db_new              (void);
 
+void                   hyscan_fix_db_set_threads      (HyScanFixDB        *fix,
+                                                       guint               n_threads);
+
+void                   hyscan_fix_db_set_keep_going   (HyScanFixDB        *fix,
+                                                       gboolean            keep_going);
+
+/* Режим сброса журналов общий для всего процесса. */
+void                   hyscan_fix_db_set_flush_mode   (HyScanFixFlushMode  mode);
+
 void                   hyscan_fix_db_upgrade          (HyScanFixDB        *fix,
                                                        const gchar        *db_path,
                                                        HyScanCancellable  *cancellable);
 
+void                   hyscan_fix_db_execute          (HyScanFixDB        *fix,
+                                                       HyScanFixPlan      *plan,
+                                                       HyScanCancellable  *cancellable);
+
 gboolean               hyscan_fix_db_complete         (HyScanFixDB        *fix);
 
+const HyScanFixDBReport *
+                       hyscan_fix_db_get_report       (HyScanFixDB        *fix);
+
 G_END_DECLS
 
 #endif /* __HYSCAN_FIX_DB_H__ */
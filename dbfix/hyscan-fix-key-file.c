@@ -0,0 +1,272 @@
+/* hyscan-fix-key-file.c
+ *
+ * Copyright 2020 Screen LLC, Andrei Fadeev <andrei@webcontrol.ru>
+ *
+ * This file is part of HyScan DBFix.
+ *
+ * HyScan DBFix is dual-licensed: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HyScan DBFix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Alternatively, you can license this code under a commercial license.
+ * Contact the Screen LLC in this case - <info@screen-co.ru>.
+ */
+
+/* HyScan DBFix имеет двойную лицензию.
+ *
+ * Во-первых, вы можете распространять HyScan DBFix на условиях Стандартной
+ * Общественной Лицензии GNU версии 3, либо по любой более поздней версии
+ * лицензии (по вашему выбору). Полные положения лицензии GNU приведены в
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Во-вторых, этот программный код можно использовать по коммерческой
+ * лицензии. Для этого свяжитесь с ООО Экран - <info@screen-co.ru>.
+ */
+
+/* Чтение файлов параметров без загрузки в GKeyFile.
+ *
+ * Для определения версии и оценки затрат из параметров галсов нужны
+ * отдельные значения, а #GKeyFile разбирает весь файл и создаёт
+ * копию каждой группы и каждого ключа. HyScanFixKeyFile отображает файл
+ * в память и ищет в нём группы и ключи без копирования данных: строки
+ * перебираются функцией memchr, а найденные значения возвращаются как
+ * фрагменты отображённого файла.
+ *
+ * Значения возвращаются в том виде, в котором они записаны в файле,
+ * без обработки экранированных символов. Это подходит для
+ * идентификаторов, чисел и названий схем, но не для произвольных строк.
+ */
+
+#include "hyscan-fix-key-file.h"
+
+#include <string.h>
+
+struct _HyScanFixKeyFile
+{
+  GMappedFile         *mapped;             /* Отображённый в память файл. */
+  const gchar         *data;               /* Данные файла. */
+  gsize                size;               /* Размер файла. */
+};
+
+/* Функция возвращает следующую строку файла без символов перевода
+ * строки и начальных пробелов. Если строк больше нет, возвращается
+ * FALSE. */
+static gboolean
+hyscan_fix_key_file_next_line (HyScanFixKeyFile *key_file,
+                               const gchar     **cursor,
+                               HyScanFixSlice   *line)
+{
+  const gchar *end = key_file->data + key_file->size;
+  const gchar *start = *cursor;
+  const gchar *eol;
+
+  if (start >= end)
+    return FALSE;
+
+  eol = memchr (start, '\n', end - start);
+  if (eol == NULL)
+    eol = end;
+
+  *cursor = eol + 1;
+
+  while ((start < eol) && ((*start == ' ') || (*start == '\t')))
+    start++;
+  if ((eol > start) && (*(eol - 1) == '\r'))
+    eol--;
+
+  line->data = start;
+  line->size = eol - start;
+
+  return TRUE;
+}
+
+/* Функция проверяет, является ли строка заголовком указанной группы. */
+static gboolean
+hyscan_fix_key_file_is_group (const HyScanFixSlice *line,
+                              const gchar          *group,
+                              gsize                 group_size)
+{
+  const gchar *end;
+
+  if ((line->size < 2) || (line->data[0] != '['))
+    return FALSE;
+
+  end = memchr (line->data, ']', line->size);
+  if (end == NULL)
+    return FALSE;
+
+  if (group == NULL)
+    return TRUE;
+
+  return ((gsize)(end - line->data - 1) == group_size) &&
+         (memcmp (line->data + 1, group, group_size) == 0);
+}
+
+/* Функция ищет заголовок группы и возвращает позицию следующей
+ * за ним строки. */
+static const gchar *
+hyscan_fix_key_file_find_group (HyScanFixKeyFile *key_file,
+                                const gchar      *group)
+{
+  const gchar *cursor = key_file->data;
+  gsize group_size = strlen (group);
+  HyScanFixSlice line;
+
+  while (hyscan_fix_key_file_next_line (key_file, &cursor, &line))
+    {
+      if (hyscan_fix_key_file_is_group (&line, group, group_size))
+        return cursor;
+    }
+
+  return NULL;
+}
+
+/**
+ * hyscan_fix_key_file_new:
+ * @file: путь к файлу параметров
+ *
+ * Функция отображает файл параметров в память для чтения.
+ *
+ * Returns: (nullable): Указатель на #HyScanFixKeyFile или NULL, если
+ * файл не удалось открыть. Для удаления #hyscan_fix_key_file_free.
+ */
+HyScanFixKeyFile *
+hyscan_fix_key_file_new (const gchar *file)
+{
+  HyScanFixKeyFile *key_file;
+  GMappedFile *mapped;
+
+  mapped = g_mapped_file_new (file, FALSE, NULL);
+  if (mapped == NULL)
+    return NULL;
+
+  key_file = g_slice_new (HyScanFixKeyFile);
+  key_file->mapped = mapped;
+  key_file->data = g_mapped_file_get_contents (mapped);
+  key_file->size = g_mapped_file_get_length (mapped);
+
+  /* Пустой файл отображается без данных. */
+  if (key_file->data == NULL)
+    key_file->size = 0;
+
+  return key_file;
+}
+
+/**
+ * hyscan_fix_key_file_has_group:
+ * @key_file: указатель на #HyScanFixKeyFile
+ * @group: название группы
+ *
+ * Функция проверяет наличие группы в файле параметров.
+ *
+ * Returns: %TRUE если группа есть в файле, иначе %FALSE.
+ */
+gboolean
+hyscan_fix_key_file_has_group (HyScanFixKeyFile *key_file,
+                               const gchar      *group)
+{
+  return hyscan_fix_key_file_find_group (key_file, group) != NULL;
+}
+
+/**
+ * hyscan_fix_key_file_lookup:
+ * @key_file: указатель на #HyScanFixKeyFile
+ * @group: название группы
+ * @key: название ключа
+ * @value: (out): значение ключа
+ *
+ * Функция ищет значение ключа в группе. Значение указывает на данные
+ * файла, действительно до вызова #hyscan_fix_key_file_free и не
+ * завершается нулём. Пробелы перед значением не включаются в него.
+ *
+ * Returns: %TRUE если ключ найден, иначе %FALSE.
+ */
+gboolean
+hyscan_fix_key_file_lookup (HyScanFixKeyFile *key_file,
+                            const gchar      *group,
+                            const gchar      *key,
+                            HyScanFixSlice   *value)
+{
+  const gchar *cursor;
+  gsize key_size = strlen (key);
+  HyScanFixSlice line;
+
+  cursor = hyscan_fix_key_file_find_group (key_file, group);
+  if (cursor == NULL)
+    return FALSE;
+
+  while (hyscan_fix_key_file_next_line (key_file, &cursor, &line))
+    {
+      const gchar *end = line.data + line.size;
+      const gchar *p;
+
+      /* Ключи группы заканчиваются на заголовке следующей группы. */
+      if (hyscan_fix_key_file_is_group (&line, NULL, 0))
+        break;
+
+      if ((line.size <= key_size) || (memcmp (line.data, key, key_size) != 0))
+        continue;
+
+      for (p = line.data + key_size; (p < end) && ((*p == ' ') || (*p == '\t')); p++);
+      if ((p == end) || (*p != '='))
+        continue;
+
+      for (p++; (p < end) && ((*p == ' ') || (*p == '\t')); p++);
+
+      value->data = p;
+      value->size = end - p;
+
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+/**
+ * hyscan_fix_key_file_get_string:
+ * @key_file: указатель на #HyScanFixKeyFile
+ * @group: название группы
+ * @key: название ключа
+ *
+ * Функция возвращает копию значения ключа в группе.
+ *
+ * Returns: (nullable): Значение ключа или NULL, если ключ не найден.
+ * Для удаления #g_free.
+ */
+gchar *
+hyscan_fix_key_file_get_string (HyScanFixKeyFile *key_file,
+                                const gchar      *group,
+                                const gchar      *key)
+{
+  HyScanFixSlice value;
+
+  if (!hyscan_fix_key_file_lookup (key_file, group, key, &value))
+    return NULL;
+
+  return g_strndup (value.data, value.size);
+}
+
+/**
+ * hyscan_fix_key_file_free:
+ * @key_file: указатель на #HyScanFixKeyFile
+ *
+ * Функция закрывает файл параметров.
+ */
+void
+hyscan_fix_key_file_free (HyScanFixKeyFile *key_file)
+{
+  if (key_file == NULL)
+    return;
+
+  g_mapped_file_unref (key_file->mapped);
+  g_slice_free (HyScanFixKeyFile, key_file);
+}
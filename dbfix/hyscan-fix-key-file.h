@@ -0,0 +1,77 @@
+/* hyscan-fix-key-file.h
+ *
+ * Copyright 2020 Screen LLC, Andrei Fadeev <andrei@webcontrol.ru>
+ *
+ * This file is part of HyScan DBFix.
+ *
+ * HyScan DBFix is dual-licensed: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HyScan DBFix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Alternatively, you can license this code under a commercial license.
+ * Contact the Screen LLC in this case - <info@screen-co.ru>.
+ */
+
+/* HyScan DBFix имеет двойную лицензию.
+ *
+ * Во-первых, вы можете распространять HyScan DBFix на условиях Стандартной
+ * Общественной Лицензии GNU версии 3, либо по любой более поздней версии
+ * лицензии (по вашему выбору). Полные положения лицензии GNU приведены в
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Во-вторых, этот программный код можно использовать по коммерческой
+ * лицензии. Для этого свяжитесь с ООО Экран - <info@screen-co.ru>.
+ */
+
+#ifndef __HYSCAN_FIX_KEY_FILE_H__
+#define __HYSCAN_FIX_KEY_FILE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * HyScanFixSlice:
+ * @data: начало строки, не завершается нулём
+ * @size: размер строки
+ *
+ * Фрагмент данных файла параметров. Фрагмент указывает на данные
+ * отображённого в память файла и действителен до его закрытия.
+ */
+typedef struct _HyScanFixSlice HyScanFixSlice;
+struct _HyScanFixSlice
+{
+  const gchar *data;
+  gsize        size;
+};
+
+typedef struct _HyScanFixKeyFile HyScanFixKeyFile;
+
+HyScanFixKeyFile *     hyscan_fix_key_file_new        (const gchar      *file);
+
+gboolean               hyscan_fix_key_file_has_group  (HyScanFixKeyFile *key_file,
+                                                       const gchar      *group);
+
+gboolean               hyscan_fix_key_file_lookup     (HyScanFixKeyFile *key_file,
+                                                       const gchar      *group,
+                                                       const gchar      *key,
+                                                       HyScanFixSlice   *value);
+
+gchar *                hyscan_fix_key_file_get_string (HyScanFixKeyFile *key_file,
+                                                       const gchar      *group,
+                                                       const gchar      *key);
+
+void                   hyscan_fix_key_file_free       (HyScanFixKeyFile *key_file);
+
+G_END_DECLS
+
+#endif /* __HYSCAN_FIX_KEY_FILE_H__ */
@@ -0,0 +1,795 @@
+/* hyscan-fix-plan.c
+ *
+ * Copyright 2020 Screen LLC, Andrei Fadeev <andrei@webcontrol.ru>
+ *
+ * This file is part of HyScan DBFix.
+ *
+ * HyScan DBFix is dual-licensed: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HyScan DBFix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Alternatively, you can license this code under a commercial license.
+ * Contact the Screen LLC in this case - <info@screen-co.ru>.
+ */
+
+/* HyScan DBFix имеет двойную лицензию.
+ *
+ * Во-первых, вы можете распространять HyScan DBFix на условиях Стандартной
+ * Общественной Лицензии GNU версии 3, либо по любой более поздней версии
+ * лицензии (по вашему выбору). Полные положения лицензии GNU приведены в
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Во-вторых, этот программный код можно использовать по коммерческой
+ * лицензии. Для этого свяжитесь с ООО Экран - <info@screen-co.ru>.
+ */
+
+/* План обновления базы данных.
+ *
+ * Сканирование определяет версии всех проектов и галсов базы данных и
+ * оценивает затраты на их обновление, ничего не изменяя в базе данных.
+ * Каталоги проектов просматриваются последовательно, галсы проверяются
+ * параллельно.
+ *
+ * План сохраняется в текстовый файл и может быть выполнен позже, в том
+ * числе по частям на нескольких машинах. Первая строка файла содержит
+ * сигнатуру и версию формата, остальные строки - записи, поля которых
+ * разделены символом табуляции:
+ *
+ * db-path     <путь к базе данных>
+ * projects    <MD5 схемы | unknown> <число проектов>
+ * tracks      <MD5 схемы | unknown> <число галсов>
+ * interrupted <число каталогов с прерванным обновлением>
+ * project     <проект> <> <MD5 схемы | unknown> <прерван> <шаги> <чтение> <запись> <копирование> <файлы>
+ * track       <проект> <галс> <MD5 схемы | unknown> <прерван> <шаги> <чтение> <запись> <копирование> <файлы>
+ *
+ * Шаги обновления перечисляются через запятую первыми восемью символами
+ * MD5 суммы исходной схемы каждого шага и служат для информации. Управляющие
+ * символы в названиях проектов и галсов экранируются.
+ *
+ * Объекты, обновление которых завершено по журналу dbfix.checkpoint,
+ * считаются обновлёнными без проверки.
+ *
+ * Оценка длительности обновления рассчитывается по объёму считываемых
+ * и записываемых данных и числу файловых операций с типовыми для жёсткого
+ * диска скоростями. Она служит для планирования, а не для точного прогноза.
+ */
+
+#include "hyscan-fix-plan.h"
+#include "hyscan-fix-checkpoint.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define PLAN_SIGNATURE         "dbfix-plan"                /* Сигнатура файла плана. */
+#define PLAN_FORMAT            1                           /* Версия формата файла плана. */
+
+#define PLAN_READ_RATE         (100.0 * 1024.0 * 1024.0)  /* Скорость чтения, байт/с. */
+#define PLAN_WRITE_RATE        (50.0 * 1024.0 * 1024.0)   /* Скорость записи, байт/с. */
+#define PLAN_FILE_TIME         0.005                      /* Время файловой операции, с. */
+
+/* Состояние сканирования базы данных. */
+typedef struct
+{
+  HyScanFixPlan       *plan;               /* План обновления. */
+  GCancellable        *cancellable;        /* Отмена сканирования. */
+  GMutex               lock;               /* Блокировка. */
+  gboolean             status;             /* Статус сканирования. */
+} HyScanFixPlanScan;
+
+/* Функция освобождает память, занятую объектом обновления. */
+static void
+hyscan_fix_plan_unit_free (gpointer data)
+{
+  HyScanFixPlanUnit *unit = data;
+
+  g_free (unit->project);
+  g_free (unit->track);
+  g_slice_free (HyScanFixPlanUnit, unit);
+}
+
+/* Функция добавляет оценку затрат к суммарной. */
+static void
+hyscan_fix_plan_add_cost (HyScanFixCost       *total,
+                          const HyScanFixCost *cost)
+{
+  total->read_bytes += cost->read_bytes;
+  total->write_bytes += cost->write_bytes;
+  total->copy_bytes += cost->copy_bytes;
+  total->n_files += cost->n_files;
+}
+
+/* Функция добавляет объект обновления в план. */
+static void
+hyscan_fix_plan_add_unit (HyScanFixPlan     *plan,
+                          HyScanFixPlanUnit *unit)
+{
+  hyscan_fix_plan_add_cost (&plan->cost, &unit->cost);
+  g_ptr_array_add (plan->units, unit);
+}
+
+/* Функция экранирует управляющие символы строки. Символы UTF-8 за
+ * пределами ASCII не экранируются, чтобы названия оставались читаемыми. */
+static gchar *
+hyscan_fix_plan_escape (const gchar *str)
+{
+  gchar exceptions[129];
+  guint i;
+
+  for (i = 0; i < 128; i++)
+    exceptions[i] = (gchar)(0x80 + i);
+  exceptions[128] = 0;
+
+  return g_strescape (str, exceptions);
+}
+
+/* Функция возвращает тип схемы объекта обновления. */
+static HyScanFixSchemaType
+hyscan_fix_plan_unit_type (const HyScanFixPlanUnit *unit)
+{
+  return (unit->track != NULL) ? HYSCAN_FIX_SCHEMA_TRACK : HYSCAN_FIX_SCHEMA_PROJECT;
+}
+
+/* Функция возвращает MD5 сумму схемы версии или "unknown". */
+static const gchar *
+hyscan_fix_plan_version_md5 (HyScanFixSchemaType type,
+                             gint                version)
+{
+  const HyScanFixSchema *schema = hyscan_fix_schema_get (type, version);
+
+  return (schema != NULL) ? schema->md5 : "unknown";
+}
+
+/* Функция возвращает версию по MD5 сумме схемы. */
+static gint
+hyscan_fix_plan_md5_version (HyScanFixSchemaType  type,
+                             const gchar         *md5)
+{
+  const HyScanFixSchema *schema = hyscan_fix_schema_find (type, md5);
+
+  if (schema != NULL)
+    return schema->version;
+
+  return (type == HYSCAN_FIX_SCHEMA_TRACK) ? HYSCAN_FIX_TRACK_UNKNOWN : HYSCAN_FIX_PROJECT_UNKNOWN;
+}
+
+/* Функция добавляет в строку список шагов обновления с указанной версии. */
+static void
+hyscan_fix_plan_append_steps (GString             *data,
+                              HyScanFixSchemaType  type,
+                              gint                 version)
+{
+  gint latest = (type == HYSCAN_FIX_SCHEMA_TRACK) ? HYSCAN_FIX_TRACK_LATEST : HYSCAN_FIX_PROJECT_LATEST;
+  const HyScanFixSchema *schema;
+
+  for (; version < latest; version++)
+    {
+      schema = hyscan_fix_schema_get (type, version);
+      if (schema == NULL)
+        break;
+
+      g_string_append_len (data, schema->md5, 8);
+      if (version + 1 < latest)
+        g_string_append_c (data, ',');
+    }
+}
+
+/* Функция разбирает запись объекта обновления. */
+static HyScanFixPlanUnit *
+hyscan_fix_plan_parse_unit (gchar **fields)
+{
+  HyScanFixPlanUnit *unit;
+  HyScanFixSchemaType type;
+
+  if (g_strv_length (fields) != 10)
+    return NULL;
+
+  unit = g_slice_new0 (HyScanFixPlanUnit);
+  unit->project = g_strcompress (fields[1]);
+  unit->track = (g_strcmp0 (fields[0], "track") == 0) ? g_strcompress (fields[2]) : NULL;
+
+  type = hyscan_fix_plan_unit_type (unit);
+  unit->version = hyscan_fix_plan_md5_version (type, fields[3]);
+  unit->interrupted = (g_strcmp0 (fields[4], "1") == 0);
+  unit->cost.read_bytes = g_ascii_strtoull (fields[6], NULL, 10);
+  unit->cost.write_bytes = g_ascii_strtoull (fields[7], NULL, 10);
+  unit->cost.copy_bytes = g_ascii_strtoull (fields[8], NULL, 10);
+  unit->cost.n_files = g_ascii_strtoull (fields[9], NULL, 10);
+
+  return unit;
+}
+
+/* Функция проверяет галс. Вызывается из потоков сканирования. */
+static void
+hyscan_fix_plan_scan_track (gpointer data,
+                            gpointer user_data)
+{
+  HyScanFixPlanUnit *unit = data;
+  HyScanFixPlanScan *scan = user_data;
+  HyScanFixPlan *plan = scan->plan;
+  gchar *track_path;
+  gchar *path;
+
+  if (g_cancellable_is_cancelled (scan->cancellable))
+    {
+      hyscan_fix_plan_unit_free (unit);
+      return;
+    }
+
+  track_path = g_build_filename (unit->project, unit->track, NULL);
+  path = g_build_filename (plan->db_path, track_path, NULL);
+
+  /* Галс, обновлённый до прерывания предыдущего запуска, не проверяется. */
+  if (hyscan_fix_checkpoint_contains (plan->db_path, unit->project, unit->track))
+    {
+      unit->version = HYSCAN_FIX_TRACK_LATEST;
+      goto exit;
+    }
+
+  /* Ошибка оценки затрат не прерывает сканирование: галс неизвестной
+   * версии или с повреждёнными параметрами учитывается в плане с нулевыми
+   * затратами, а его обновление завершится ошибкой. */
+  unit->interrupted = hyscan_fix_journal_exist (path);
+  unit->version = hyscan_fix_track_probe_version (plan->db_path, track_path);
+  hyscan_fix_track_estimate (plan->db_path, track_path, unit->version, &unit->cost);
+
+exit:
+  g_mutex_lock (&scan->lock);
+
+  plan->n_tracks[unit->version] += 1;
+  if (unit->interrupted)
+    plan->n_interrupted += 1;
+
+  /* Прерванное обновление откатывается при выполнении плана, поэтому
+   * такой галс включается в план независимо от его версии. */
+  if (unit->interrupted ||
+      ((unit->version != HYSCAN_FIX_TRACK_NOT_TRACK) &&
+       (unit->version != HYSCAN_FIX_TRACK_LATEST)))
+    {
+      hyscan_fix_plan_add_unit (plan, g_steal_pointer (&unit));
+    }
+
+  g_mutex_unlock (&scan->lock);
+
+  if (unit != NULL)
+    hyscan_fix_plan_unit_free (unit);
+
+  g_free (track_path);
+  g_free (path);
+}
+
+/* Функция проверяет проект и передаёт его галсы в потоки сканирования. */
+static gboolean
+hyscan_fix_plan_scan_project (HyScanFixPlanScan *scan,
+                              GThreadPool       *pool,
+                              const gchar       *project_name)
+{
+  HyScanFixPlan *plan = scan->plan;
+  HyScanFixPlanUnit *unit;
+  HyScanFixDirIter *tracks;
+  const gchar *name;
+  gboolean checkpoint;
+  gboolean is_dir;
+  gchar *path;
+
+  unit = g_slice_new0 (HyScanFixPlanUnit);
+  unit->project = g_strdup (project_name);
+  checkpoint = hyscan_fix_checkpoint_contains (plan->db_path, project_name, NULL);
+  if (checkpoint)
+    unit->version = HYSCAN_FIX_PROJECT_LATEST;
+  else
+    unit->version = hyscan_fix_project_probe_version (plan->db_path, project_name);
+
+  if (unit->version == HYSCAN_FIX_PROJECT_NOT_PROJECT)
+    {
+      hyscan_fix_plan_unit_free (unit);
+      return TRUE;
+    }
+
+  /* Проект, прерванный после записи новой схемы, определяется как
+   * обновлённый, поэтому журналы проверяются для всех проектов, кроме
+   * обновлённых до прерывания предыдущего запуска. */
+  path = g_build_filename (plan->db_path, project_name, NULL);
+  if (!checkpoint)
+    unit->interrupted = hyscan_fix_journal_exist (path);
+
+  hyscan_fix_project_estimate (plan->db_path, project_name, unit->version, &unit->cost);
+
+  g_mutex_lock (&scan->lock);
+
+  plan->n_projects[unit->version] += 1;
+  if (unit->interrupted)
+    plan->n_interrupted += 1;
+
+  if (unit->interrupted || (unit->version != HYSCAN_FIX_PROJECT_LATEST))
+    hyscan_fix_plan_add_unit (plan, g_steal_pointer (&unit));
+
+  g_mutex_unlock (&scan->lock);
+
+  if (unit != NULL)
+    hyscan_fix_plan_unit_free (unit);
+
+  tracks = hyscan_fix_dir_iter_new (path);
+  g_free (path);
+
+  if (tracks == NULL)
+    return FALSE;
+
+  while (hyscan_fix_dir_iter_next (tracks, &name, &is_dir))
+    {
+      if (!is_dir)
+        continue;
+
+      unit = g_slice_new0 (HyScanFixPlanUnit);
+      unit->project = g_strdup (project_name);
+      unit->track = g_strdup (name);
+
+      g_thread_pool_push (pool, unit, NULL);
+    }
+
+  hyscan_fix_dir_iter_free (tracks);
+
+  return TRUE;
+}
+
+/* Функция сравнивает объекты обновления по объёму записываемых данных. */
+static gint
+hyscan_fix_plan_compare_write (gconstpointer a,
+                               gconstpointer b)
+{
+  const HyScanFixPlanUnit *unit_a = *(HyScanFixPlanUnit **)a;
+  const HyScanFixPlanUnit *unit_b = *(HyScanFixPlanUnit **)b;
+
+  if (unit_a->cost.write_bytes > unit_b->cost.write_bytes)
+    return -1;
+  if (unit_a->cost.write_bytes < unit_b->cost.write_bytes)
+    return 1;
+
+  return 0;
+}
+
+/**
+ * hyscan_fix_plan_new:
+ * @db_path: (nullable): путь к базе данных
+ *
+ * Функция создаёт пустой план обновления.
+ *
+ * Returns: (transfer full): План обновления. Для удаления #hyscan_fix_plan_free.
+ */
+HyScanFixPlan *
+hyscan_fix_plan_new (const gchar *db_path)
+{
+  HyScanFixPlan *plan;
+
+  plan = g_slice_new0 (HyScanFixPlan);
+  plan->db_path = g_strdup (db_path);
+  plan->units = g_ptr_array_new_with_free_func (hyscan_fix_plan_unit_free);
+
+  return plan;
+}
+
+/**
+ * hyscan_fix_plan_add:
+ * @plan: план обновления
+ * @unit: объект обновления
+ *
+ * Функция добавляет в план копию объекта обновления и учитывает его
+ * версию и затраты на обновление.
+ */
+void
+hyscan_fix_plan_add (HyScanFixPlan           *plan,
+                     const HyScanFixPlanUnit *unit)
+{
+  HyScanFixPlanUnit *copy;
+
+  copy = g_slice_dup (HyScanFixPlanUnit, unit);
+  copy->project = g_strdup (unit->project);
+  copy->track = g_strdup (unit->track);
+
+  if (copy->track != NULL)
+    plan->n_tracks[copy->version] += 1;
+  else
+    plan->n_projects[copy->version] += 1;
+  if (copy->interrupted)
+    plan->n_interrupted += 1;
+
+  hyscan_fix_plan_add_unit (plan, copy);
+}
+
+/**
+ * hyscan_fix_plan_scan:
+ * @db_path: путь к базе данных
+ * @n_threads: число потоков сканирования галсов, 0 - по числу процессоров
+ * @cancellable: (nullable): указатель на #HyScanCancellable
+ *
+ * Функция определяет версии всех проектов и галсов базы данных и оценивает
+ * затраты на их обновление. База данных при этом не изменяется. Для
+ * ускорения повторного сканирования можно предварительно загрузить кэш
+ * контрольных сумм функцией #hyscan_fix_cache_load.
+ *
+ * Returns: (transfer full) (nullable): План обновления или NULL в случае
+ * ошибки или отмены. Для удаления #hyscan_fix_plan_free.
+ */
+HyScanFixPlan *
+hyscan_fix_plan_scan (const gchar       *db_path,
+                      guint              n_threads,
+                      HyScanCancellable *cancellable)
+{
+  HyScanFixPlanScan scan;
+  GThreadPool *pool;
+  gchar **projects;
+  guint n_projects;
+  guint i;
+
+  projects = hyscan_fix_dir_list (db_path);
+  if (projects == NULL)
+    return NULL;
+
+  scan.plan = hyscan_fix_plan_new (db_path);
+  scan.cancellable = (cancellable != NULL) ? G_CANCELLABLE (cancellable) : NULL;
+  scan.status = TRUE;
+  g_mutex_init (&scan.lock);
+
+  if (n_threads == 0)
+    n_threads = g_get_num_processors ();
+
+  n_projects = g_strv_length (projects);
+  if (cancellable != NULL)
+    hyscan_cancellable_push (cancellable);
+
+  pool = g_thread_pool_new (hyscan_fix_plan_scan_track, &scan, n_threads, FALSE, NULL);
+  for (i = 0; scan.status && (i < n_projects); i++)
+    {
+      if (g_cancellable_is_cancelled (scan.cancellable))
+        break;
+
+      if (cancellable != NULL)
+        hyscan_cancellable_set_total (cancellable, i, 0, n_projects);
+
+      if (!hyscan_fix_plan_scan_project (&scan, pool, projects[i]))
+        scan.status = FALSE;
+    }
+  g_thread_pool_free (pool, FALSE, TRUE);
+
+  if (cancellable != NULL)
+    hyscan_cancellable_pop (cancellable);
+
+  if (g_cancellable_is_cancelled (scan.cancellable))
+    scan.status = FALSE;
+
+  g_mutex_clear (&scan.lock);
+  g_strfreev (projects);
+
+  if (!scan.status)
+    g_clear_pointer (&scan.plan, hyscan_fix_plan_free);
+
+  return scan.plan;
+}
+
+/**
+ * hyscan_fix_plan_save:
+ * @plan: план обновления
+ * @file_name: путь к файлу плана
+ *
+ * Функция сохраняет план обновления в файл. Файл записывается атомарно.
+ *
+ * Returns: %TRUE если план сохранён, иначе %FALSE.
+ */
+gboolean
+hyscan_fix_plan_save (HyScanFixPlan *plan,
+                      const gchar   *file_name)
+{
+  gboolean status;
+  GString *data;
+  gchar *escaped;
+  gint version;
+  guint i;
+
+  data = g_string_new (NULL);
+
+  escaped = hyscan_fix_plan_escape (plan->db_path);
+  g_string_append_printf (data, "%s\t%d\n", PLAN_SIGNATURE, PLAN_FORMAT);
+  g_string_append_printf (data, "db-path\t%s\n", escaped);
+  g_free (escaped);
+
+  for (version = HYSCAN_FIX_PROJECT_UNKNOWN; version < HYSCAN_FIX_PROJECT_LAST; version++)
+    {
+      if (plan->n_projects[version] > 0)
+        {
+          g_string_append_printf (data, "projects\t%s\t%u\n",
+                                  hyscan_fix_plan_version_md5 (HYSCAN_FIX_SCHEMA_PROJECT, version),
+                                  plan->n_projects[version]);
+        }
+    }
+
+  for (version = HYSCAN_FIX_TRACK_UNKNOWN; version < HYSCAN_FIX_TRACK_LAST; version++)
+    {
+      if (plan->n_tracks[version] > 0)
+        {
+          g_string_append_printf (data, "tracks\t%s\t%u\n",
+                                  hyscan_fix_plan_version_md5 (HYSCAN_FIX_SCHEMA_TRACK, version),
+                                  plan->n_tracks[version]);
+        }
+    }
+
+  g_string_append_printf (data, "interrupted\t%u\n", plan->n_interrupted);
+
+  for (i = 0; i < plan->units->len; i++)
+    {
+      HyScanFixPlanUnit *unit = plan->units->pdata[i];
+      HyScanFixSchemaType type = hyscan_fix_plan_unit_type (unit);
+      gchar *project = hyscan_fix_plan_escape (unit->project);
+      gchar *track = hyscan_fix_plan_escape ((unit->track != NULL) ? unit->track : "");
+
+      g_string_append_printf (data, "%s\t%s\t%s\t%s\t%d\t",
+                              (type == HYSCAN_FIX_SCHEMA_TRACK) ? "track" : "project",
+                              project, track,
+                              hyscan_fix_plan_version_md5 (type, unit->version),
+                              unit->interrupted ? 1 : 0);
+      hyscan_fix_plan_append_steps (data, type, unit->version);
+      g_string_append_printf (data, "\t%" G_GUINT64_FORMAT "\t%" G_GUINT64_FORMAT
+                                    "\t%" G_GUINT64_FORMAT "\t%" G_GUINT64_FORMAT "\n",
+                              unit->cost.read_bytes, unit->cost.write_bytes,
+                              unit->cost.copy_bytes, unit->cost.n_files);
+
+      g_free (project);
+      g_free (track);
+    }
+
+  status = g_file_set_contents (file_name, data->str, data->len, NULL);
+
+  g_string_free (data, TRUE);
+
+  return status;
+}
+
+/**
+ * hyscan_fix_plan_load:
+ * @file_name: путь к файлу плана
+ *
+ * Функция загружает план обновления из файла.
+ *
+ * Returns: (transfer full) (nullable): План обновления или NULL в случае
+ * ошибки. Для удаления #hyscan_fix_plan_free.
+ */
+HyScanFixPlan *
+hyscan_fix_plan_load (const gchar *file_name)
+{
+  HyScanFixPlan *plan = NULL;
+  gchar *data = NULL;
+  gchar **lines = NULL;
+  gchar *signature;
+  guint i;
+
+  if (!g_file_get_contents (file_name, &data, NULL, NULL))
+    return NULL;
+
+  lines = g_strsplit (data, "\n", -1);
+  g_free (data);
+
+  signature = g_strdup_printf ("%s\t%d", PLAN_SIGNATURE, PLAN_FORMAT);
+  if ((lines[0] == NULL) || (g_strcmp0 (lines[0], signature) != 0))
+    goto exit;
+
+  plan = hyscan_fix_plan_new (NULL);
+
+  for (i = 1; lines[i] != NULL; i++)
+    {
+      gchar **fields;
+      guint n_fields;
+
+      if (lines[i][0] == 0)
+        continue;
+
+      fields = g_strsplit (lines[i], "\t", -1);
+      n_fields = g_strv_length (fields);
+
+      if ((g_strcmp0 (fields[0], "db-path") == 0) && (n_fields == 2))
+        {
+          g_free (plan->db_path);
+          plan->db_path = g_strcompress (fields[1]);
+        }
+      else if ((g_strcmp0 (fields[0], "projects") == 0) && (n_fields == 3))
+        {
+          gint version = hyscan_fix_plan_md5_version (HYSCAN_FIX_SCHEMA_PROJECT, fields[1]);
+          plan->n_projects[version] += strtoul (fields[2], NULL, 10);
+        }
+      else if ((g_strcmp0 (fields[0], "tracks") == 0) && (n_fields == 3))
+        {
+          gint version = hyscan_fix_plan_md5_version (HYSCAN_FIX_SCHEMA_TRACK, fields[1]);
+          plan->n_tracks[version] += strtoul (fields[2], NULL, 10);
+        }
+      else if ((g_strcmp0 (fields[0], "interrupted") == 0) && (n_fields == 2))
+        {
+          plan->n_interrupted = strtoul (fields[1], NULL, 10);
+        }
+      else if ((g_strcmp0 (fields[0], "project") == 0) ||
+               (g_strcmp0 (fields[0], "track") == 0))
+        {
+          HyScanFixPlanUnit *unit = hyscan_fix_plan_parse_unit (fields);
+
+          if (unit != NULL)
+            hyscan_fix_plan_add_unit (plan, unit);
+          else
+            g_clear_pointer (&plan, hyscan_fix_plan_free);
+        }
+      else
+        {
+          g_clear_pointer (&plan, hyscan_fix_plan_free);
+        }
+
+      g_strfreev (fields);
+
+      if (plan == NULL)
+        break;
+    }
+
+  if ((plan != NULL) && (plan->db_path == NULL))
+    g_clear_pointer (&plan, hyscan_fix_plan_free);
+
+exit:
+  g_strfreev (lines);
+  g_free (signature);
+
+  return plan;
+}
+
+/**
+ * hyscan_fix_plan_select:
+ * @plan: план обновления
+ * @shard: номер части плана, начиная с 0
+ * @n_shards: число частей плана
+ *
+ * Функция оставляет в плане только объекты указанной части. План делится
+ * по проектам: проект и все его галсы всегда попадают в одну часть, так
+ * как параметры проекта обновляются после его галсов. Разбиение зависит
+ * только от названий проектов и одинаково на всех машинах.
+ *
+ * Счётчики объектов и оценка затрат пересчитываются по оставшимся
+ * объектам. Объекты актуальной версии без прерванного обновления в план
+ * не входят, поэтому после разделения они не учитываются.
+ */
+void
+hyscan_fix_plan_select (HyScanFixPlan *plan,
+                        guint          shard,
+                        guint          n_shards)
+{
+  GPtrArray *units;
+  guint i;
+
+  g_return_if_fail (shard < n_shards);
+
+  units = g_ptr_array_new_with_free_func (hyscan_fix_plan_unit_free);
+  memset (plan->n_projects, 0, sizeof (plan->n_projects));
+  memset (plan->n_tracks, 0, sizeof (plan->n_tracks));
+  memset (&plan->cost, 0, sizeof (plan->cost));
+  plan->n_interrupted = 0;
+
+  /* Объекты переносятся в новый массив с сохранением порядка. */
+  g_ptr_array_set_free_func (plan->units, NULL);
+  for (i = 0; i < plan->units->len; i++)
+    {
+      HyScanFixPlanUnit *unit = plan->units->pdata[i];
+
+      if ((g_str_hash (unit->project) % n_shards) == shard)
+        {
+          if (unit->track != NULL)
+            plan->n_tracks[unit->version] += 1;
+          else
+            plan->n_projects[unit->version] += 1;
+          if (unit->interrupted)
+            plan->n_interrupted += 1;
+
+          hyscan_fix_plan_add_cost (&plan->cost, &unit->cost);
+          g_ptr_array_add (units, unit);
+        }
+      else
+        {
+          hyscan_fix_plan_unit_free (unit);
+        }
+    }
+
+  g_ptr_array_unref (plan->units);
+  plan->units = units;
+}
+
+/**
+ * hyscan_fix_plan_get_space:
+ * @plan: план обновления
+ * @n_threads: число потоков обновления галсов, 0 - по числу процессоров
+ *
+ * Функция оценивает объём свободного места, необходимого для обновления.
+ * Резервные копии удаляются после обновления каждого объекта, поэтому
+ * одновременно на диске находятся данные только обновляемых параллельно
+ * объектов.
+ *
+ * Returns: Объём свободного места, байт.
+ */
+guint64
+hyscan_fix_plan_get_space (HyScanFixPlan *plan,
+                           guint          n_threads)
+{
+  GPtrArray *units;
+  guint64 space = 0;
+  guint i;
+
+  if (n_threads == 0)
+    n_threads = g_get_num_processors ();
+
+  units = g_ptr_array_sized_new (plan->units->len);
+  for (i = 0; i < plan->units->len; i++)
+    g_ptr_array_add (units, plan->units->pdata[i]);
+  g_ptr_array_sort (units, hyscan_fix_plan_compare_write);
+
+  for (i = 0; (i < units->len) && (i < n_threads); i++)
+    space += ((HyScanFixPlanUnit *)units->pdata[i])->cost.write_bytes;
+
+  g_ptr_array_unref (units);
+
+  return space;
+}
+
+/**
+ * hyscan_fix_plan_get_duration:
+ * @plan: план обновления
+ * @n_threads: число потоков обновления галсов, 0 - по числу процессоров
+ *
+ * Функция оценивает длительность обновления. Скорость обмена с диском
+ * считается не зависящей от числа потоков, задержки файловых операций
+ * делятся между потоками.
+ *
+ * Returns: Длительность обновления, секунды.
+ */
+gdouble
+hyscan_fix_plan_get_duration (HyScanFixPlan *plan,
+                              guint          n_threads)
+{
+  if (n_threads == 0)
+    n_threads = g_get_num_processors ();
+
+  return plan->cost.read_bytes / PLAN_READ_RATE +
+         plan->cost.write_bytes / PLAN_WRITE_RATE +
+         plan->cost.n_files * PLAN_FILE_TIME / n_threads;
+}
+
+/**
+ * hyscan_fix_plan_unit_get_work:
+ * @unit: объект обновления
+ *
+ * Функция возвращает объём работы по обновлению объекта, выраженный в
+ * байтах. Файловые операции пересчитываются в объём данных, записываемых
+ * за то же время, поэтому объекты без данных каналов также имеют вес.
+ *
+ * Returns: Объём работы, байт.
+ */
+guint64
+hyscan_fix_plan_unit_get_work (const HyScanFixPlanUnit *unit)
+{
+  return unit->cost.read_bytes + unit->cost.write_bytes +
+         unit->cost.n_files * (guint64)(PLAN_FILE_TIME * PLAN_WRITE_RATE);
+}
+
+/**
+ * hyscan_fix_plan_free:
+ * @plan: план обновления
+ *
+ * Функция освобождает память, занятую планом обновления.
+ */
+void
+hyscan_fix_plan_free (HyScanFixPlan *plan)
+{
+  if (plan == NULL)
+    return;
+
+  g_ptr_array_unref (plan->units);
+  g_free (plan->db_path);
+  g_slice_free (HyScanFixPlan, plan);
+}
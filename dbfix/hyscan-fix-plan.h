@@ -0,0 +1,118 @@
+/* hyscan-fix-plan.h
+ *
+ * Copyright 2020 Screen LLC, Andrei Fadeev <andrei@webcontrol.ru>
+ *
+ * This file is part of HyScan DBFix.
+ *
+ * HyScan DBFix is dual-licensed: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HyScan DBFix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Alternatively, you can license this code under a commercial license.
+ * Contact the Screen LLC in this case - <info@screen-co.ru>.
+ */
+
+/* HyScan DBFix имеет двойную лицензию.
+ *
+ * Во-первых, вы можете распространять HyScan DBFix на условиях Стандартной
+ * Общественной Лицензии GNU версии 3, либо по любой более поздней версии
+ * лицензии (по вашему выбору). Полные положения лицензии GNU приведены в
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Во-вторых, этот программный код можно использовать по коммерческой
+ * лицензии. Для этого свяжитесь с ООО Экран - <info@screen-co.ru>.
+ */
+
+#ifndef __HYSCAN_FIX_PLAN_H__
+#define __HYSCAN_FIX_PLAN_H__
+
+#include <hyscan-cancellable.h>
+#include "hyscan-fix-common.h"
+#include "hyscan-fix-project.h"
+#include "hyscan-fix-track.h"
+
+G_BEGIN_DECLS
+
+/**
+ * HyScanFixPlanUnit:
+ * @project: название проекта
+ * @track: название галса или NULL для параметров проекта
+ * @version: текущая версия формата данных (#HyScanFixProjectVersion или #HyScanFixTrackVersion)
+ * @interrupted: признак прерванного обновления
+ * @cost: оценка затрат на обновление
+ *
+ * Объект обновления: параметры проекта или галс.
+ */
+typedef struct _HyScanFixPlanUnit HyScanFixPlanUnit;
+struct _HyScanFixPlanUnit
+{
+  gchar               *project;
+  gchar               *track;
+  gint                 version;
+  gboolean             interrupted;
+  HyScanFixCost        cost;
+};
+
+/**
+ * HyScanFixPlan:
+ * @db_path: путь к базе данных
+ * @units: (element-type HyScanFixPlanUnit): объекты, требующие обновления или
+ *   отката прерванного обновления
+ * @n_projects: число проектов каждой версии
+ * @n_tracks: число галсов каждой версии
+ * @n_interrupted: число каталогов с прерванным обновлением
+ * @cost: суммарная оценка затрат на обновление
+ *
+ * План обновления базы данных.
+ */
+typedef struct _HyScanFixPlan HyScanFixPlan;
+struct _HyScanFixPlan
+{
+  gchar               *db_path;
+  GPtrArray           *units;
+  guint                n_projects[HYSCAN_FIX_PROJECT_LAST];
+  guint                n_tracks[HYSCAN_FIX_TRACK_LAST];
+  guint                n_interrupted;
+  HyScanFixCost        cost;
+};
+
+HyScanFixPlan *        hyscan_fix_plan_new           (const gchar        *db_path);
+
+void                   hyscan_fix_plan_add           (HyScanFixPlan      *plan,
+                                                      const HyScanFixPlanUnit *unit);
+
+HyScanFixPlan *        hyscan_fix_plan_scan          (const gchar        *db_path,
+                                                      guint               n_threads,
+                                                      HyScanCancellable  *cancellable);
+
+gboolean               hyscan_fix_plan_save          (HyScanFixPlan      *plan,
+                                                      const gchar        *file_name);
+
+HyScanFixPlan *        hyscan_fix_plan_load          (const gchar        *file_name);
+
+void                   hyscan_fix_plan_select        (HyScanFixPlan      *plan,
+                                                      guint               shard,
+                                                      guint               n_shards);
+
+guint64                hyscan_fix_plan_get_space     (HyScanFixPlan      *plan,
+                                                      guint               n_threads);
+
+gdouble                hyscan_fix_plan_get_duration  (HyScanFixPlan      *plan,
+                                                      guint               n_threads);
+
+guint64                hyscan_fix_plan_unit_get_work (const HyScanFixPlanUnit *unit);
+
+void                   hyscan_fix_plan_free          (HyScanFixPlan      *plan);
+
+G_END_DECLS
+
+#endif /* __HYSCAN_FIX_PLAN_H__ */
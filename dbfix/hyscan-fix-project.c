@@ -34,49 +34,18 @@
 
 #include "hyscan-fix-project.h"
 #include "hyscan-fix-common.h"
+#include "hyscan-fix-cache.h"
+#include "hyscan-fix-key-file.h"
+#include "hyscan-fix-rules.h"
 #include "hyscan-fix-track.h"
 
+#include <glib/gstdio.h>
+#include <string.h>
+
 #define PROJECT_FILE_MAGIC     0x52505348      /* HSPR в виде строки. */
 #define PROJECT_FILE_VERSION   0x31303731      /* 1701 в виде строки. */
 
-/* Функция возвращает значение контрольной суммы для версии схемы. */
-static const gchar *
-hyscan_fix_project_get_hash (HyScanFixProjectVersion version)
-{
-  switch (version)
-    {
-    case HYSCAN_FIX_PROJECT_3E65462D:
-      return "3e65462db44e1dc9317f38a063d60ef1";
-    case HYSCAN_FIX_PROJECT_6190124D:
-      return "6190124dbc946f010e07a5ffb86f68ee";
-    case HYSCAN_FIX_PROJECT_2C71F69B:
-      return "2c71f69b31e8d610da88edcb8a165fe0";
-    case HYSCAN_FIX_PROJECT_E38FABCF:
-      return "e38fabcf1b95fced8c87447c1ffa0f32";
-    case HYSCAN_FIX_PROJECT_3C282D25:
-      return "3c282d259e3db686fef4c3b26dde5edc";
-    case HYSCAN_FIX_PROJECT_7F9EB90C:
-      return "7f9eb90c7f852d6457d7a1bdc5d9b012";
-    case HYSCAN_FIX_PROJECT_FD8E8922:
-      return "fd8e8922e61b89e749e7b076444c039e";
-    case HYSCAN_FIX_PROJECT_DE7491C1:
-      return "de7491c1298d4368ad87ded88e617fea";
-    case HYSCAN_FIX_PROJECT_AD1F40A3:
-      return "ad1f40a3292926b566fe8ed6465a6e64";
-    case HYSCAN_FIX_PROJECT_B288BA04:
-      return "b288ba043bea8a11886a458a4bfab4a8";
-    case HYSCAN_FIX_PROJECT_C95A6F48:
-      return "c95a6f48d4f0f2784dfd45351ab83f8a";
-    case HYSCAN_FIX_PROJECT_8C1D17C8:
-      return "8c1d17c827ebbc76fca7548e4ca06226";
-    default:
-      break;
-    }
-
-  return NULL;
-}
-
-/* Функция преобразовывает идентификаторы источников данных.
+/* Таблица преобразования идентификаторов источников данных.
  *
  * SIDE_SCAN_STARBOARD     101, 201 -> 2
  * SIDE_SCAN_PORT          102, 202 -> 5
@@ -84,67 +53,204 @@ hyscan_fix_project_get_hash (HyScanFixProjectVersion version)
  * SIDE_SCAN_PORT_HI       104, 204 -> 7
  * ECHOSOUNDER             107, 205 -> 8
  * PROFILER                108, 209 -> 13
+ *
+ * Неизвестные идентификаторы заменяются на -1.
  */
-static gint
-hyscan_fix_project_update_source_enum_6190124d (gint source)
+static const HyScanFixRuleEnum hyscan_fix_project_sources_6190124d[] =
+{
+  { "101", "2" }, { "201", "2" },
+  { "102", "5" }, { "202", "5" },
+  { "103", "4" }, { "203", "4" },
+  { "104", "7" }, { "204", "7" },
+  { "107", "8" }, { "205", "8" },
+  { "108", "13" }, { "209", "13" },
+  { NULL, NULL }
+};
+
+/* Таблица преобразования численных значений идентификаторов источников
+ * данных в строковые названия. Метки с неизвестными источниками
+ * остаются без источника. */
+static const HyScanFixRuleEnum hyscan_fix_project_sources_7f9eb90c[] =
+{
+  { "2", "ss-starboard" },
+  { "3", "ss-starboard-low" },
+  { "4", "ss-starboard-hi" },
+  { "5", "ss-port" },
+  { "6", "ss-port-low" },
+  { "7", "ss-port-hi" },
+  { "8", "echosounder" },
+  { "9", "echosounder-low" },
+  { "10", "echosounder-hi" },
+  { "13", "profiler" },
+  { "14", "profiler-echo" },
+  { NULL, NULL }
+};
+
+/* Файлы параметров проекта, изменяемые при обновлении. */
+typedef enum
 {
-  switch (source)
+  HYSCAN_FIX_PROJECT_FILE_INFO,
+  HYSCAN_FIX_PROJECT_FILE_WATERFALL_MARK,
+  HYSCAN_FIX_PROJECT_FILE_GEO_MARK,
+  HYSCAN_FIX_PROJECT_FILE_PLANNER,
+  HYSCAN_FIX_PROJECT_FILE_LAST
+} HyScanFixProjectFile;
+
+/* Параметры проекта, изменяемые при обновлении. Файлы, которые шаги
+ * обновления только преобразуют по правилам, не загружаются: наборы
+ * правил накапливаются и применяются при записи одним потоковым проходом
+ * по файлу. Остальные файлы формируются в памяти. Все файлы записываются
+ * один раз в конце обновления. */
+typedef struct
+{
+  const gchar     *db_path;
+  const gchar     *project_path;
+  GKeyFile        *files[HYSCAN_FIX_PROJECT_FILE_LAST];
+  const gchar     *sources[HYSCAN_FIX_PROJECT_FILE_LAST];
+  GPtrArray       *rules[HYSCAN_FIX_PROJECT_FILE_LAST];
+} HyScanFixProjectParams;
+
+static const gchar *hyscan_fix_project_files[] =
+{
+  "info.prm",
+  "waterfall-mark.prm",
+  "geo-mark.prm",
+  "planner.prm"
+};
+
+/* Функция задаёт имя файла, из которого будут прочитаны параметры,
+ * если оно отличается от текущего. Накопленные преобразования
+ * отменяются. */
+static void
+hyscan_fix_project_params_source (HyScanFixProjectParams *params,
+                                  HyScanFixProjectFile    file,
+                                  const gchar            *name)
+{
+  g_clear_pointer (&params->files[file], g_key_file_unref);
+  g_clear_pointer (&params->rules[file], g_ptr_array_unref);
+
+  params->sources[file] = name;
+  params->rules[file] = g_ptr_array_new ();
+}
+
+/* Функция заменяет параметры файла проекта. */
+static void
+hyscan_fix_project_params_set (HyScanFixProjectParams *params,
+                               HyScanFixProjectFile    file,
+                               GKeyFile               *key_file)
+{
+  g_clear_pointer (&params->files[file], g_key_file_unref);
+  g_clear_pointer (&params->rules[file], g_ptr_array_unref);
+  params->files[file] = key_file;
+}
+
+/* Функция добавляет преобразование параметров файла проекта по набору
+ * правил. Параметры, сформированные в памяти, преобразуются сразу. */
+static void
+hyscan_fix_project_apply_rules (HyScanFixProjectParams *params,
+                                HyScanFixProjectFile    file,
+                                HyScanFixRules         *rules)
+{
+  if (params->files[file] != NULL)
     {
-    case 101:
-    case 201:
-      return 2;
-    case 102:
-    case 202:
-      return 5;
-    case 103:
-    case 203:
-      return 4;
-    case 104:
-    case 204:
-      return 7;
-    case 107:
-    case 205:
-      return 8;
-    case 108:
-    case 209:
-      return 13;
+      hyscan_fix_project_params_set (params, file, hyscan_fix_rules_apply (rules, params->files[file]));
+      return;
     }
 
-  return -1;
+  if (params->rules[file] == NULL)
+    params->rules[file] = g_ptr_array_new ();
+
+  g_ptr_array_add (params->rules[file], rules);
 }
 
-/* Функция преобразовывает численное значение идентификатора источника
- * данных в строковое название.*/
-static const gchar *
-hyscan_fix_project_get_source_by_id_7f9eb90c (gint source)
+/* Функция создаёт резервные копии и записывает все изменённые
+ * файлы параметров проекта. Если шаги обновления только переименовывают
+ * ключи, которых в файле нет, файл остаётся без изменений. Файл,
+ * из которого прочитаны параметры под другим названием, помечается
+ * для удаления только после записи нового файла. */
+static gboolean
+hyscan_fix_project_params_commit (HyScanFixProjectParams *params)
 {
-  switch (source)
+  gboolean status = FALSE;
+  gchar *prm_file = NULL;
+  gchar *src_file = NULL;
+  gboolean changed;
+  guint i;
+
+  for (i = 0; i < HYSCAN_FIX_PROJECT_FILE_LAST; i++)
     {
-    case 2:
-      return "ss-starboard";
-    case 3:
-      return "ss-starboard-low";
-    case 4:
-      return "ss-starboard-hi";
-    case 5:
-      return "ss-port";
-    case 6:
-      return "ss-port-low";
-    case 7:
-      return "ss-port-hi";
-    case 8:
-      return "echosounder";
-    case 9:
-      return "echosounder-low";
-    case 10:
-      return "echosounder-hi";
-    case 13:
-      return "profiler";
-    case 14:
-      return "profiler-echo";
+      const gchar *source;
+
+      if ((params->files[i] == NULL) && (params->rules[i] == NULL))
+        continue;
+
+      /* Файл, который правила не изменят, не копируется и
+       * не перезаписывается. */
+      if ((params->files[i] == NULL) && (params->sources[i] == NULL))
+        {
+          prm_file = g_build_filename (params->db_path, params->project_path, "project.prm",
+                                       hyscan_fix_project_files[i], NULL);
+          changed = hyscan_fix_rules_check ((HyScanFixRules **)params->rules[i]->pdata,
+                                            params->rules[i]->len, prm_file);
+          g_clear_pointer (&prm_file, g_free);
+
+          if (!changed)
+            continue;
+        }
+
+      prm_file = g_build_filename (params->project_path, "project.prm", hyscan_fix_project_files[i], NULL);
+      if (!hyscan_fix_file_backup (params->db_path, prm_file, FALSE))
+        goto exit;
+      g_free (prm_file);
+
+      prm_file = g_build_filename (params->db_path, params->project_path, "project.prm", hyscan_fix_project_files[i], NULL);
+      if (params->files[i] != NULL)
+        {
+          if (!g_key_file_save_to_file (params->files[i], prm_file, NULL))
+            goto exit;
+        }
+      else
+        {
+          source = (params->sources[i] != NULL) ? params->sources[i] : hyscan_fix_project_files[i];
+          src_file = g_build_filename (params->db_path, params->project_path, "project.prm", source, NULL);
+          if (!hyscan_fix_rules_stream ((HyScanFixRules **)params->rules[i]->pdata, params->rules[i]->len,
+                                        src_file, prm_file))
+            {
+              goto exit;
+            }
+          g_clear_pointer (&src_file, g_free);
+        }
+      g_clear_pointer (&prm_file, g_free);
+
+      if (params->sources[i] != NULL)
+        {
+          src_file = g_build_filename (params->project_path, "project.prm", params->sources[i], NULL);
+          if (!hyscan_fix_file_mark_remove (params->db_path, src_file))
+            goto exit;
+          g_clear_pointer (&src_file, g_free);
+        }
     }
 
-  return NULL;
+  status = TRUE;
+
+exit:
+  g_free (prm_file);
+  g_free (src_file);
+
+  return status;
+}
+
+/* Функция освобождает параметры проекта. */
+static void
+hyscan_fix_project_params_clear (HyScanFixProjectParams *params)
+{
+  guint i;
+
+  for (i = 0; i < HYSCAN_FIX_PROJECT_FILE_LAST; i++)
+    {
+      g_clear_pointer (&params->files[i], g_key_file_unref);
+      g_clear_pointer (&params->rules[i], g_ptr_array_unref);
+    }
 }
 
 /* Функция записывает схему параметров проекта для указанной версии. */
@@ -158,7 +264,8 @@ hyscan_fix_project_set_schema (const gchar             *db_path,
 
   sch_file = g_build_filename (project_path, "project.prm", "project.sch", NULL);
   if (hyscan_fix_file_backup (db_path, sch_file, TRUE))
-    status = hyscan_fix_file_schema (db_path, sch_file, hyscan_fix_project_get_hash (version));
+    status = hyscan_fix_file_schema (db_path, sch_file,
+                                     hyscan_fix_schema_get (HYSCAN_FIX_SCHEMA_PROJECT, version));
   g_free (sch_file);
 
   return status;
@@ -172,20 +279,10 @@ hyscan_fix_project_set_schema (const gchar             *db_path,
  * При обновлении до 6190124d добавлена схема для водопадных меток.
  */
 static gboolean
-hyscan_fix_project_3e65462d (const gchar *db_path,
-                             const gchar *project_path)
+hyscan_fix_project_3e65462d (HyScanFixProjectParams *params)
 {
-  gboolean status = FALSE;
-
-  /* Обновление схемы параметров проекта. */
-  if (!hyscan_fix_project_set_schema (db_path, project_path, HYSCAN_FIX_PROJECT_6190124D))
-    goto exit;
-
-  /* Уборка. */
-  status = hyscan_fix_cleanup (db_path);
-
-exit:
-  return status;
+  /* Изменилась только схема параметров проекта. */
+  return TRUE;
 }
 
 /* Функция обновляет формат данных параметров проекта с версии 6190124d
@@ -199,27 +296,29 @@ exit:
  * источников данных меток.
  */
 static gboolean
-hyscan_fix_project_6190124d (const gchar *db_path,
-                             const gchar *project_path)
+hyscan_fix_project_6190124d (HyScanFixProjectParams *params)
 {
+  static const HyScanFixRule rules_6190124d[] =
+  {
+    HYSCAN_FIX_ENUM_MAP ("/coordinates/source0", NULL, HYSCAN_FIX_VALUE_INTEGER,
+                         hyscan_fix_project_sources_6190124d, "-1")
+  };
+  static HyScanFixRules rules = HYSCAN_FIX_RULES (rules_6190124d);
+
+  const gchar *db_path = params->db_path;
+  const gchar *project_path = params->project_path;
   gboolean status = FALSE;
   HyScanFixFileIDType id;
   gchar *id_file = NULL;
   gchar *project_ids = NULL;
   gchar *track_ids = NULL;
-  gchar *project_info_file = NULL;
   gchar *track_info_file = NULL;
   gchar *old_mark_file = NULL;
-  gchar *new_mark_file = NULL;
   gchar *tracks_path = NULL;
   gchar **tracks = NULL;
   GKeyFile *project_info = NULL;
-  GKeyFile *track_info = NULL;
-  GKeyFile *params_in = NULL;
-  GKeyFile *params_out = NULL;
-  gchar **groups = NULL;
-  gchar **keys = NULL;
-  guint i,j;
+  HyScanFixKeyFile *track_info = NULL;
+  guint i;
 
   /* Дата и время создания проекта. */
   id_file = g_build_filename (project_path, "project.id", NULL);
@@ -249,99 +348,59 @@ hyscan_fix_project_6190124d (const gchar *db_path,
     {
       HyScanFixTrackVersion version;
 
-      version = hyscan_fix_track_get_version (tracks_path, tracks[i]);
+      version = hyscan_fix_track_probe_version (tracks_path, tracks[i]);
       if (version == HYSCAN_FIX_TRACK_NOT_TRACK)
         continue;
       if (version != HYSCAN_FIX_TRACK_LATEST)
         goto exit;
 
-      track_info = g_key_file_new ();
+      /* Из параметров галса нужен только идентификатор, поэтому
+       * файл не загружается целиком. */
       track_info_file = g_build_filename (tracks_path, tracks[i], "track.prm", NULL);
-      if (!g_key_file_load_from_file (track_info, track_info_file, G_KEY_FILE_NONE, NULL))
+      track_info = hyscan_fix_key_file_new (track_info_file);
+      if (track_info == NULL)
         goto exit;
 
-      track_ids = g_key_file_get_string (track_info, "track", "/id", NULL);
+      track_ids = hyscan_fix_key_file_get_string (track_info, "track", "/id");
       if (track_ids == NULL)
         goto exit;
 
       g_key_file_set_string (project_info, track_ids, "schema-id", "track-info");
       g_key_file_set_int64 (project_info, track_ids, "/mtime", g_get_real_time ());
 
-      g_clear_pointer (&track_info, g_key_file_unref);
+      g_clear_pointer (&track_info, hyscan_fix_key_file_free);
       g_clear_pointer (&track_info_file, g_free);
       g_clear_pointer (&track_ids, g_free);
     }
 
-  /* Сохраняем группу с информацией. */
-  project_info_file = g_build_filename (db_path, project_path, "project.prm", "info.prm", NULL);
-  if (!g_key_file_save_to_file (project_info, project_info_file, NULL))
-    goto exit;
+  /* Группа с информацией будет записана вместе с остальными параметрами. */
+  hyscan_fix_project_params_set (params, HYSCAN_FIX_PROJECT_FILE_INFO, g_steal_pointer (&project_info));
 
-  /* Копируем водопадные метки. */
+  /* Водопадные метки загружаются из файла со старым названием,
+   * который удаляется после записи нового файла. Если старого файла
+   * нет, преобразуется уже существующий файл с новым названием. */
   old_mark_file = g_build_filename (project_path, "project.prm", "waterfall-marks.prm", NULL);
-  new_mark_file = g_build_filename (project_path, "project.prm", "waterfall-mark.prm", NULL);
-  if (!hyscan_fix_file_copy (db_path, old_mark_file, new_mark_file, FALSE))
-    goto exit;
-
-  /* Преобразование параметров меток. */
-  g_free (new_mark_file);
-  new_mark_file = g_build_filename (db_path, project_path, "project.prm", "waterfall-mark.prm", NULL);
-
-  params_in = g_key_file_new ();
-  g_key_file_load_from_file (params_in, new_mark_file, G_KEY_FILE_NONE, NULL);
-
-  params_out = g_key_file_new ();
-  groups = g_key_file_get_groups (params_in, NULL);
-
-  for (i = 0; groups != NULL && groups[i] != NULL; i++)
+  if (hyscan_fix_file_exist (db_path, old_mark_file))
     {
-      keys = g_key_file_get_keys (params_in, groups[i], NULL, NULL);
-
-      for (j = 0; keys != NULL && keys[j] != NULL; j++)
-        {
-          if (g_strcmp0 (keys[j], "/coordinates/source0") == 0)
-            {
-              gint source_old = g_key_file_get_integer (params_in, groups[i], keys[j], NULL);
-              gint source_new = hyscan_fix_project_update_source_enum_6190124d (source_old);
-              g_key_file_set_integer (params_out, groups[i], keys[j], source_new);
-            }
-          else
-            {
-              gchar *value = g_key_file_get_string (params_in, groups[i], keys[j], NULL);
-              g_key_file_set_string (params_out, groups[i], keys[j], value);
-              g_free (value);
-              continue;
-            }
-        }
-
-      g_strfreev (keys);
+      hyscan_fix_project_params_source (params, HYSCAN_FIX_PROJECT_FILE_WATERFALL_MARK,
+                                        "waterfall-marks.prm");
     }
 
-  /* Записываем изменённые параметры. */
-  if (!g_key_file_save_to_file (params_out, new_mark_file, NULL))
-    goto exit;
-
-  g_strfreev (groups);
-
-  /* Обновление схемы параметров проекта. */
-  if (!hyscan_fix_project_set_schema (db_path, project_path, HYSCAN_FIX_PROJECT_E38FABCF))
-    goto exit;
+  /* Преобразование параметров меток. */
+  hyscan_fix_project_apply_rules (params, HYSCAN_FIX_PROJECT_FILE_WATERFALL_MARK, &rules);
 
-  /* Уборка. */
-  status = hyscan_fix_cleanup (db_path);
+  status = TRUE;
 
 exit:
   g_clear_pointer (&project_info, g_key_file_unref);
-  g_clear_pointer (&track_info, g_key_file_unref);
+  g_clear_pointer (&track_info, hyscan_fix_key_file_free);
   g_strfreev (tracks);
   g_free (id_file);
   g_free (tracks_path);
   g_free (project_ids);
   g_free (track_ids);
-  g_free (project_info_file);
   g_free (track_info_file);
   g_free (old_mark_file);
-  g_free (new_mark_file);
 
   return status;
 }
@@ -355,20 +414,10 @@ exit:
  * При обновлении до 3c282d25 добавлена схема для геометок.
  */
 static gboolean
-hyscan_fix_project_e38fabcf (const gchar *db_path,
-                             const gchar *project_path)
+hyscan_fix_project_e38fabcf (HyScanFixProjectParams *params)
 {
-  gboolean status = FALSE;
-
-  /* Обновление схемы параметров проекта. */
-  if (!hyscan_fix_project_set_schema (db_path, project_path, HYSCAN_FIX_PROJECT_3C282D25))
-    goto exit;
-
-  /* Уборка. */
-  status = hyscan_fix_cleanup (db_path);
-
-exit:
-  return status;
+  /* Изменилась только схема параметров проекта. */
+  return TRUE;
 }
 
 /* Функция обновляет формат данных параметров проекта с версии 3c282d25
@@ -389,115 +438,26 @@ exit:
  * /coordinates/height  -> /height + преобразование в метры из мм
  */
 static gboolean
-hyscan_fix_project_3c282d25 (const gchar *db_path,
-                             const gchar *project_path)
+hyscan_fix_project_3c282d25 (HyScanFixProjectParams *params)
 {
-  gboolean status = FALSE;
-  gchar *prm_file = NULL;
-
-  GKeyFile *params_in = NULL;
-  GKeyFile *params_out = NULL;
-  gchar **groups = NULL;
-  guint i, j;
-
-  /* Бэкап меток. */
-  prm_file = g_build_filename (project_path, "project.prm", "waterfall-mark.prm", NULL);
-  if (!hyscan_fix_file_backup (db_path, prm_file, FALSE))
-    goto exit;
+  static const HyScanFixRule rules_3c282d25[] =
+  {
+    HYSCAN_FIX_RENAME ("/time/creation", "/ctime", HYSCAN_FIX_VALUE_INT64),
+    HYSCAN_FIX_RENAME ("/time/modification", "/mtime", HYSCAN_FIX_VALUE_INT64),
+    HYSCAN_FIX_RENAME ("/coordinates/source0", "/source", HYSCAN_FIX_VALUE_INTEGER),
+    HYSCAN_FIX_RENAME ("/coordinates/index0", "/index", HYSCAN_FIX_VALUE_INTEGER),
+    HYSCAN_FIX_RENAME ("/coordinates/count0", "/count", HYSCAN_FIX_VALUE_INTEGER),
+    HYSCAN_FIX_RENAME ("/coordinates/lat", "/lat", HYSCAN_FIX_VALUE_DOUBLE),
+    HYSCAN_FIX_RENAME ("/coordinates/lon", "/lon", HYSCAN_FIX_VALUE_DOUBLE),
+    HYSCAN_FIX_SCALE ("/coordinates/width", "/width", 1000.0),
+    HYSCAN_FIX_SCALE ("/coordinates/height", "/height", 1000.0)
+  };
+  static HyScanFixRules rules = HYSCAN_FIX_RULES (rules_3c282d25);
 
   /* Преобразование параметров меток. */
-  g_free (prm_file);
-  prm_file = g_build_filename (db_path, project_path, "project.prm", "waterfall-mark.prm", NULL);
-
-  params_in = g_key_file_new ();
-  params_out = g_key_file_new ();
-
-  g_key_file_load_from_file (params_in, prm_file, G_KEY_FILE_NONE, NULL);
-  groups = g_key_file_get_groups (params_in, NULL);
+  hyscan_fix_project_apply_rules (params, HYSCAN_FIX_PROJECT_FILE_WATERFALL_MARK, &rules);
 
-  for (i = 0; groups != NULL && groups[i] != NULL; i++)
-    {
-      gchar **keys = g_key_file_get_keys (params_in, groups[i], NULL, NULL);
-
-      for (j = 0; keys != NULL && keys[j] != NULL; j++)
-        {
-          if (g_strcmp0 (keys[j], "/time/creation") == 0)
-            {
-              gint64 ctime = g_key_file_get_int64 (params_in, groups[i], keys[j], NULL);
-              g_key_file_set_int64 (params_out, groups[i], "/ctime", ctime);
-            }
-          else if (g_strcmp0 (keys[j], "/time/modification") == 0)
-            {
-              gint64 mtime = g_key_file_get_int64 (params_in, groups[i], keys[j], NULL);
-              g_key_file_set_int64 (params_out, groups[i], "/mtime", mtime);
-            }
-          else if (g_strcmp0 (keys[j], "/coordinates/source0") == 0)
-            {
-              gint source = g_key_file_get_integer (params_in, groups[i], keys[j], NULL);
-              g_key_file_set_integer (params_out, groups[i], "/source", source);
-            }
-          else if (g_strcmp0 (keys[j], "/coordinates/index0") == 0)
-            {
-              gint index = g_key_file_get_integer (params_in, groups[i], keys[j], NULL);
-              g_key_file_set_integer (params_out, groups[i], "/index", index);
-            }
-          else if (g_strcmp0 (keys[j], "/coordinates/count0") == 0)
-            {
-              gint count = g_key_file_get_integer (params_in, groups[i], keys[j], NULL);
-              g_key_file_set_integer (params_out, groups[i], "/count", count);
-            }
-          else if (g_strcmp0 (keys[j], "/coordinates/lat") == 0)
-            {
-              gdouble lat = g_key_file_get_double (params_in, groups[i], keys[j], NULL);
-              g_key_file_set_double (params_out, groups[i], "/lat", lat);
-            }
-          else if (g_strcmp0 (keys[j], "/coordinates/lon") == 0)
-            {
-              gdouble lon = g_key_file_get_double (params_in, groups[i], keys[j], NULL);
-              g_key_file_set_double (params_out, groups[i], "/lon", lon);
-            }
-          else if (g_strcmp0 (keys[j], "/coordinates/width") == 0)
-            {
-              gdouble width = g_key_file_get_double (params_in, groups[i], keys[j], NULL);
-              width /= 1000.0;
-              g_key_file_set_double (params_out, groups[i], "/width", width);
-            }
-          else if (g_strcmp0 (keys[j], "/coordinates/height") == 0)
-            {
-              gdouble height = g_key_file_get_double (params_in, groups[i], keys[j], NULL);
-              height /= 1000.0;
-              g_key_file_set_double (params_out, groups[i], "/height", height);
-            }
-          else
-            {
-              gchar *value = g_key_file_get_string (params_in, groups[i], keys[j], NULL);
-              g_key_file_set_string (params_out, groups[i], keys[j], value);
-              g_free (value);
-            }
-        }
-
-      g_strfreev (keys);
-    }
-
-  g_strfreev (groups);
-
-  /* Записываем изменённые параметры. */
-  if (!g_key_file_save_to_file (params_out, prm_file, NULL))
-    goto exit;
-
-  /* Обновление схемы параметров галса. */
-  if (!hyscan_fix_project_set_schema (db_path, project_path, HYSCAN_FIX_PROJECT_7F9EB90C))
-    goto exit;
-
-  /* Уборка. */
-  status = hyscan_fix_cleanup (db_path);
-
-exit:
-  g_clear_pointer (&params_in, g_key_file_unref);
-  g_clear_pointer (&params_out, g_key_file_unref);
-  g_free (prm_file);
-
-  return status;
+  return TRUE;
 }
 
 /* Функция обновляет формат данных параметров проекта с версии 7f9eb90c
@@ -509,76 +469,19 @@ exit:
  * integer на string.
  */
 static gboolean
-hyscan_fix_project_7f9eb90c (const gchar *db_path,
-                             const gchar *project_path)
+hyscan_fix_project_7f9eb90c (HyScanFixProjectParams *params)
 {
-  gboolean status = FALSE;
-  gchar *prm_file = NULL;
-
-  GKeyFile *params_in = NULL;
-  GKeyFile *params_out = NULL;
-  gchar **groups = NULL;
-  gchar **keys = NULL;
-  guint i,j;
-
-  /* Бэкап меток. */
-  prm_file = g_build_filename (project_path, "project.prm", "waterfall-mark.prm", NULL);
-  if (!hyscan_fix_file_backup (db_path, prm_file, FALSE))
-    goto exit;
+  static const HyScanFixRule rules_7f9eb90c[] =
+  {
+    HYSCAN_FIX_ENUM_MAP ("/source", NULL, HYSCAN_FIX_VALUE_INTEGER,
+                         hyscan_fix_project_sources_7f9eb90c, NULL)
+  };
+  static HyScanFixRules rules = HYSCAN_FIX_RULES (rules_7f9eb90c);
 
   /* Преобразование параметров меток. */
-  g_free (prm_file);
-  prm_file = g_build_filename (db_path, project_path, "project.prm", "waterfall-mark.prm", NULL);
-
-  params_in = g_key_file_new ();
-  g_key_file_load_from_file (params_in, prm_file, G_KEY_FILE_NONE, NULL);
-
-  params_out = g_key_file_new ();
-  groups = g_key_file_get_groups (params_in, NULL);
-
-  for (i = 0; groups != NULL && groups[i] != NULL; i++)
-    {
-      keys = g_key_file_get_keys (params_in, groups[i], NULL, NULL);
-
-      for (j = 0; keys != NULL && keys[j] != NULL; j++)
-        {
-          if (g_strcmp0 (keys[j], "/source") == 0)
-            {
-              gint source_id = g_key_file_get_integer (params_in, groups[i], keys[j], NULL);
-              const gchar *source = hyscan_fix_project_get_source_by_id_7f9eb90c (source_id);
-              g_key_file_set_string (params_out, groups[i], keys[j], source);
-            }
-          else
-            {
-              gchar *value = g_key_file_get_string (params_in, groups[i], keys[j], NULL);
-              g_key_file_set_string (params_out, groups[i], keys[j], value);
-              g_free (value);
-              continue;
-            }
-        }
-
-      g_strfreev (keys);
-    }
-
-  g_strfreev (groups);
-
-  /* Записываем изменённые параметры. */
-  if (!g_key_file_save_to_file (params_out, prm_file, NULL))
-    goto exit;
-
-  /* Обновление схемы параметров галса. */
-  if (!hyscan_fix_project_set_schema (db_path, project_path, HYSCAN_FIX_PROJECT_FD8E8922))
-    goto exit;
-
-  /* Уборка. */
-  status = hyscan_fix_cleanup (db_path);
-
-exit:
-  g_clear_pointer (&params_in, g_key_file_unref);
-  g_clear_pointer (&params_out, g_key_file_unref);
-  g_free (prm_file);
+  hyscan_fix_project_apply_rules (params, HYSCAN_FIX_PROJECT_FILE_WATERFALL_MARK, &rules);
 
-  return status;
+  return TRUE;
 }
 
 /* Функция обновляет формат данных параметров проекта с версии fd8e8922
@@ -590,20 +493,10 @@ exit:
  * Данные не изменяются.
  */
 static gboolean
-hyscan_fix_project_fd8e8922 (const gchar *db_path,
-                             const gchar *project_path)
+hyscan_fix_project_fd8e8922 (HyScanFixProjectParams *params)
 {
-  gboolean status = FALSE;
-
-  /* Обновление схемы параметров проекта. */
-  if (!hyscan_fix_project_set_schema (db_path, project_path, HYSCAN_FIX_PROJECT_DE7491C1))
-    goto exit;
-
-  /* Уборка. */
-  status = hyscan_fix_cleanup (db_path);
-
-exit:
-  return status;
+  /* Изменилась только схема параметров проекта. */
+  return TRUE;
 }
 
 /* Функция обновляет формат данных параметров проекта с версии de7491c1
@@ -616,20 +509,10 @@ exit:
  * реального использования этих схем нет.
  */
 static gboolean
-hyscan_fix_project_de7491c1 (const gchar *db_path,
-                             const gchar *project_path)
+hyscan_fix_project_de7491c1 (HyScanFixProjectParams *params)
 {
-  gboolean status = FALSE;
-
-  /* Обновление схемы параметров проекта. */
-  if (!hyscan_fix_project_set_schema (db_path, project_path, HYSCAN_FIX_PROJECT_AD1F40A3))
-    goto exit;
-
-  /* Уборка. */
-  status = hyscan_fix_cleanup (db_path);
-
-exit:
-  return status;
+  /* Изменилась только схема параметров проекта. */
+  return TRUE;
 }
 
 /* Функция обновляет формат данных параметров проекта с версии ad1f40a3
@@ -641,20 +524,10 @@ exit:
  * реального использования этих схем нет.
  */
 static gboolean
-hyscan_fix_project_ad1f40a3 (const gchar *db_path,
-                             const gchar *project_path)
+hyscan_fix_project_ad1f40a3 (HyScanFixProjectParams *params)
 {
-  gboolean status = FALSE;
-
-  /* Обновление схемы параметров проекта. */
-  if (!hyscan_fix_project_set_schema (db_path, project_path, HYSCAN_FIX_PROJECT_B288BA04))
-    goto exit;
-
-  /* Уборка. */
-  status = hyscan_fix_cleanup (db_path);
-
-exit:
-  return status;
+  /* Изменилась только схема параметров проекта. */
+  return TRUE;
 }
 
 /* Функция обновляет формат данных параметров проекта с версии b288ba04
@@ -670,88 +543,21 @@ exit:
  * /end-lon   -> /end/lon
  */
 static gboolean
-hyscan_fix_project_b288ba04 (const gchar *db_path,
-                             const gchar *project_path)
+hyscan_fix_project_b288ba04 (HyScanFixProjectParams *params)
 {
-  gboolean status = FALSE;
-  gchar *prm_file = NULL;
-
-  GKeyFile *params_in = NULL;
-  GKeyFile *params_out = NULL;
-  gchar **groups = NULL;
-  guint i, j;
-
-  /* Бэкап плана съёмки. */
-  prm_file = g_build_filename (project_path, "project.prm", "planner.prm", NULL);
-  if (!hyscan_fix_file_backup (db_path, prm_file, FALSE))
-    goto exit;
+  static const HyScanFixRule rules_b288ba04[] =
+  {
+    HYSCAN_FIX_RENAME ("/start-lat", "/start/lat", HYSCAN_FIX_VALUE_DOUBLE),
+    HYSCAN_FIX_RENAME ("/start-lon", "/start/lon", HYSCAN_FIX_VALUE_DOUBLE),
+    HYSCAN_FIX_RENAME ("/end-lat", "/end/lat", HYSCAN_FIX_VALUE_DOUBLE),
+    HYSCAN_FIX_RENAME ("/end-lon", "/end/lon", HYSCAN_FIX_VALUE_DOUBLE)
+  };
+  static HyScanFixRules rules = HYSCAN_FIX_RULES (rules_b288ba04);
 
   /* Преобразование параметров плана съёмки. */
-  g_free (prm_file);
-  prm_file = g_build_filename (db_path, project_path, "project.prm", "planner.prm", NULL);
-
-  params_in = g_key_file_new ();
-  params_out = g_key_file_new ();
-
-  g_key_file_load_from_file (params_in, prm_file, G_KEY_FILE_NONE, NULL);
-  groups = g_key_file_get_groups (params_in, NULL);
-
-  for (i = 0; groups != NULL && groups[i] != NULL; i++)
-    {
-      gchar **keys = g_key_file_get_keys (params_in, groups[i], NULL, NULL);
-
-      for (j = 0; keys != NULL && keys[j] != NULL; j++)
-        {
-          if (g_strcmp0 (keys[j], "/start-lat") == 0)
-            {
-              gdouble start_lat = g_key_file_get_double (params_in, groups[i], keys[j], NULL);
-              g_key_file_set_double (params_out, groups[i], "/start/lat", start_lat);
-            }
-          else if (g_strcmp0 (keys[j], "/start-lon") == 0)
-            {
-              gdouble start_lon = g_key_file_get_double (params_in, groups[i], keys[j], NULL);
-              g_key_file_set_double (params_out, groups[i], "/start/lon", start_lon);
-            }
-          else if (g_strcmp0 (keys[j], "/end-lat") == 0)
-            {
-              gdouble end_lat = g_key_file_get_double (params_in, groups[i], keys[j], NULL);
-              g_key_file_set_double (params_out, groups[i], "/end/lat", end_lat);
-            }
-          else if (g_strcmp0 (keys[j], "/end-lon") == 0)
-            {
-              gdouble end_lon = g_key_file_get_double (params_in, groups[i], keys[j], NULL);
-              g_key_file_set_double (params_out, groups[i], "/end/lon", end_lon);
-            }
-          else
-            {
-              gchar *value = g_key_file_get_string (params_in, groups[i], keys[j], NULL);
-              g_key_file_set_string (params_out, groups[i], keys[j], value);
-              g_free (value);
-            }
-        }
+  hyscan_fix_project_apply_rules (params, HYSCAN_FIX_PROJECT_FILE_PLANNER, &rules);
 
-      g_strfreev (keys);
-    }
-
-  g_strfreev (groups);
-
-  /* Записываем изменённые параметры. */
-  if (!g_key_file_save_to_file (params_out, prm_file, NULL))
-    goto exit;
-
-  /* Обновление схемы параметров галса. */
-  if (!hyscan_fix_project_set_schema (db_path, project_path, HYSCAN_FIX_PROJECT_C95A6F48))
-    goto exit;
-
-  /* Уборка. */
-  status = hyscan_fix_cleanup (db_path);
-
-exit:
-  g_clear_pointer (&params_in, g_key_file_unref);
-  g_clear_pointer (&params_out, g_key_file_unref);
-  g_free (prm_file);
-
-  return status;
+  return TRUE;
 }
 
 /* Функция обновляет формат данных параметров проекта с версии c95a6f48
@@ -767,131 +573,69 @@ exit:
  * - добавлена схема параметров отображения галсов на планшете "map-track".
  */
 static gboolean
-hyscan_fix_project_c95a6f48 (const gchar *db_path,
-                             const gchar *project_path)
+hyscan_fix_project_c95a6f48 (HyScanFixProjectParams *params)
 {
-  gboolean status = FALSE;
-  const gchar *files[] = {"waterfall-mark.prm", "geo-mark.prm"};
-  gchar *prm_file = NULL;
-  guint k;
-
-  for (k = 0; k < G_N_ELEMENTS (files); k++)
-    {
-      gboolean file_status;
-      GKeyFile *params_in;
-      GKeyFile *params_out;
-      gchar **groups;
-      guint i, j;
-
-      /* Бэкап меток. */
-      prm_file = g_build_filename (project_path, "project.prm", files[k], NULL);
-      if (!hyscan_fix_file_backup (db_path, prm_file, FALSE))
-        goto exit;
-
-      /* Преобразование параметров меток. */
-      g_free (prm_file);
-      prm_file = g_build_filename (db_path, project_path, "project.prm", files[k], NULL);
-
-      params_in = g_key_file_new ();
-      params_out = g_key_file_new ();
-
-      g_key_file_load_from_file (params_in, prm_file, G_KEY_FILE_NONE, NULL);
-      groups = g_key_file_get_groups (params_in, NULL);
+  static const HyScanFixRule rules_c95a6f48[] =
+  {
+    HYSCAN_FIX_RENAME ("/label", "/labels", HYSCAN_FIX_VALUE_INT64)
+  };
+  static HyScanFixRules rules = HYSCAN_FIX_RULES (rules_c95a6f48);
 
-      for (i = 0; groups != NULL && groups[i] != NULL; i++)
-        {
-          gchar **keys = g_key_file_get_keys (params_in, groups[i], NULL, NULL);
-
-          for (j = 0; keys != NULL && keys[j] != NULL; j++)
-            {
-              if (g_strcmp0 (keys[j], "/label") == 0)
-                {
-                  gint64 labels = g_key_file_get_int64 (params_in, groups[i], keys[j], NULL);
-                  g_key_file_set_int64 (params_out, groups[i], "/labels", labels);
-                }
-              else
-                {
-                  gchar *value = g_key_file_get_string (params_in, groups[i], keys[j], NULL);
-                  g_key_file_set_string (params_out, groups[i], keys[j], value);
-                  g_free (value);
-                }
-            }
-
-          g_strfreev (keys);
-        }
-
-      g_strfreev (groups);
-
-      /* Записываем изменённые параметры. */
-      file_status = g_key_file_save_to_file (params_out, prm_file, NULL);
-      g_key_file_unref (params_in);
-      g_key_file_unref (params_out);
-      g_clear_pointer (&prm_file, g_free);
-
-      if (!file_status)
-        goto exit;
-    }
-
-  /* Обновление схемы параметров проекта. */
-  if (!hyscan_fix_project_set_schema (db_path, project_path, HYSCAN_FIX_PROJECT_8C1D17C8))
-    goto exit;
-
-  /* Уборка. */
-  status = hyscan_fix_cleanup (db_path);
-
-exit:
-  g_free (prm_file);
+  /* Преобразование параметров меток. */
+  hyscan_fix_project_apply_rules (params, HYSCAN_FIX_PROJECT_FILE_WATERFALL_MARK, &rules);
+  hyscan_fix_project_apply_rules (params, HYSCAN_FIX_PROJECT_FILE_GEO_MARK, &rules);
 
-  return status;
+  return TRUE;
 }
 
 /**
- * hyscan_fix_project_get_version:
+ * hyscan_fix_project_probe_version:
  * @db_path: путь к базе данных (каталог с проектами)
  * @project_path: путь к проекту относительно db_path
  *
- * Функция определяет версию формата данных параметров проекта.
+ * Функция определяет версию формата данных параметров проекта. Функция
+ * ничего не записывает в базу данных, в том числе в журнал обновления.
  *
  * Returns: Версия формата данных параметров проекта.
  */
 HyScanFixProjectVersion
-hyscan_fix_project_get_version (const gchar *db_path,
-                                const gchar *project_path)
+hyscan_fix_project_probe_version (const gchar *db_path,
+                                  const gchar *project_path)
 {
   HyScanFixProjectVersion version = HYSCAN_FIX_PROJECT_NOT_PROJECT;
   HyScanFixFileIDType id;
 
+  const HyScanFixSchema *schema = NULL;
   gchar *id_file = NULL;
   gchar *sch_file = NULL;
   gchar *sch_md5 = NULL;
 
-  id_file = g_build_filename (project_path, "project.id", NULL);
-  id = hyscan_fix_file_db_id (db_path, id_file);
-  if ((GUINT32_FROM_LE (id.magic) != PROJECT_FILE_MAGIC) ||
-      (GUINT32_FROM_LE (id.version) != PROJECT_FILE_VERSION))
-    {
-      goto exit;
-    }
-
-  version = HYSCAN_FIX_PROJECT_UNKNOWN;
-
+  /* Контрольная сумма схемы неизменённого файла берётся из кэша. В кэш
+   * попадают только файлы с проверенным идентификатором. */
   sch_file = g_build_filename (project_path, "project.prm", "project.sch", NULL);
-  sch_md5 = hyscan_fix_file_md5 (db_path, sch_file);
-  if (sch_md5 == NULL)
-    goto exit;
-
-  while (version < HYSCAN_FIX_PROJECT_LAST)
+  sch_md5 = hyscan_fix_cache_lookup (db_path, sch_file);
+  if (sch_md5 != NULL)
     {
-      if (g_strcmp0 (sch_md5, hyscan_fix_project_get_hash (version)) == 0)
-        break;
-      version += 1;
+      schema = hyscan_fix_schema_find (HYSCAN_FIX_SCHEMA_PROJECT, sch_md5);
     }
+  else
+    {
+      id_file = g_build_filename (project_path, "project.id", NULL);
+      id = hyscan_fix_file_db_id (db_path, id_file);
+      if ((GUINT32_FROM_LE (id.magic) != PROJECT_FILE_MAGIC) ||
+          (GUINT32_FROM_LE (id.version) != PROJECT_FILE_VERSION))
+        {
+          goto exit;
+        }
 
-  if (version == HYSCAN_FIX_PROJECT_LAST)
-    version = HYSCAN_FIX_PROJECT_UNKNOWN;
+      /* Файл схемы сравнивается с таблицей известных схем сначала по
+       * размеру и только затем по контрольной сумме. */
+      schema = hyscan_fix_schema_detect (HYSCAN_FIX_SCHEMA_PROJECT, db_path, sch_file);
+      if (schema != NULL)
+        hyscan_fix_cache_update (db_path, sch_file, schema->md5);
+    }
 
-  if (version == HYSCAN_FIX_PROJECT_UNKNOWN)
-    hyscan_fix_log (db_path, "unknown project version %s - %s", project_path, sch_md5);
+  version = (schema != NULL) ? schema->version : HYSCAN_FIX_PROJECT_UNKNOWN;
 
 exit:
   g_free (sch_md5);
@@ -902,87 +646,183 @@ exit:
 }
 
 /**
- * hyscan_fix_project:
+ * hyscan_fix_project_estimate:
  * @db_path: путь к базе данных (каталог с проектами)
  * @project_path: путь к проекту относительно db_path
+ * @version: текущая версия формата данных параметров проекта
+ * @cost: (out): оценка затрат
  *
- * Функция обновляет формат данных параметров проекта. При этом
- * происходит последовательное обновление формата данных от одной
- * версии к другой, до текущей используемой в HyScan.
+ * Функция оценивает затраты на обновление параметров проекта без изменения
+ * данных. Оценка предполагает, что каждый существующий файл параметров
+ * проекта копируется в резервную копию и перезаписывается.
  *
- * Returns: %TRUE если обновление успешно завершено, иначе %FALSE.
+ * Returns: %TRUE если оценка выполнена, иначе %FALSE.
  */
 gboolean
-hyscan_fix_project (const gchar *db_path,
-                    const gchar *project_path)
+hyscan_fix_project_estimate (const gchar             *db_path,
+                             const gchar             *project_path,
+                             HyScanFixProjectVersion  version,
+                             HyScanFixCost           *cost)
 {
+  const HyScanFixSchema *schema;
+  const gchar *old_files[] = { "waterfall-marks.prm", "project.sch" };
+  GStatBuf info;
+  gchar *file;
+  guint i;
+
+  memset (cost, 0, sizeof (*cost));
+
+  if ((version == HYSCAN_FIX_PROJECT_NOT_PROJECT) || (version == HYSCAN_FIX_PROJECT_LATEST))
+    return TRUE;
+  if ((version == HYSCAN_FIX_PROJECT_UNKNOWN) || (version == HYSCAN_FIX_PROJECT_LAST))
+    return FALSE;
+
+  for (i = 0; i < HYSCAN_FIX_PROJECT_FILE_LAST + G_N_ELEMENTS (old_files); i++)
+    {
+      const gchar *name;
+
+      if (i < HYSCAN_FIX_PROJECT_FILE_LAST)
+        name = hyscan_fix_project_files[i];
+      else
+        name = old_files[i - HYSCAN_FIX_PROJECT_FILE_LAST];
+
+      file = g_build_filename (db_path, project_path, "project.prm", name, NULL);
+      if (g_stat (file, &info) == 0)
+        {
+          cost->read_bytes += info.st_size;
+          cost->write_bytes += 2 * info.st_size;
+          cost->n_files += 2;
+        }
+      g_free (file);
+    }
+
+  /* Новая схема записывается вместо старой. */
+  schema = hyscan_fix_schema_get (HYSCAN_FIX_SCHEMA_PROJECT, HYSCAN_FIX_PROJECT_LATEST);
+  cost->write_bytes += schema->size;
+  cost->n_files += 1;
+
+  return TRUE;
+}
+
+/* Функция обновляет формат данных параметров проекта. Шаги обновления
+ * накапливают изменения файлов параметров, после чего каждый изменённый
+ * файл и схема записываются один раз в рамках одного набора резервных
+ * копий. */
+static gboolean
+hyscan_fix_project_upgrade (const gchar *db_path,
+                            const gchar *project_path)
+{
+  HyScanFixProjectParams params = { db_path, project_path, { NULL } };
   HyScanFixProjectVersion version;
   gboolean status = TRUE;
 
-  /* Проверяем состояние базы данных и откатываем изменения
+  /* Проверяем состояние проекта и откатываем изменения
    * в случае ошибки при предыдущем обновлении. */
   if (!hyscan_fix_revert (db_path))
     return FALSE;
 
-  version = hyscan_fix_project_get_version (db_path, project_path);
+  version = hyscan_fix_project_probe_version (db_path, project_path);
+  if ((version == HYSCAN_FIX_PROJECT_NOT_PROJECT) || (version == HYSCAN_FIX_PROJECT_LATEST))
+    return TRUE;
+  if ((version == HYSCAN_FIX_PROJECT_UNKNOWN) || (version == HYSCAN_FIX_PROJECT_LAST))
+    return FALSE;
+
+  /* Преобразование параметров проекта. */
   switch (version)
     {
-    case HYSCAN_FIX_PROJECT_NOT_PROJECT:
-      status = TRUE;
-      break;
-
-    case HYSCAN_FIX_PROJECT_UNKNOWN:
-      status = FALSE;
-      break;
-
     case HYSCAN_FIX_PROJECT_3E65462D:
       if (status)
-        status = hyscan_fix_project_3e65462d (db_path, project_path);
+        status = hyscan_fix_project_3e65462d (&params);
 
     case HYSCAN_FIX_PROJECT_6190124D:
       if (status)
-        status = hyscan_fix_project_6190124d (db_path, project_path);
+        status = hyscan_fix_project_6190124d (&params);
 
     case HYSCAN_FIX_PROJECT_2C71F69B:
     case HYSCAN_FIX_PROJECT_E38FABCF:
       if (status)
-        status = hyscan_fix_project_e38fabcf (db_path, project_path);
+        status = hyscan_fix_project_e38fabcf (&params);
 
     case HYSCAN_FIX_PROJECT_3C282D25:
       if (status)
-        status = hyscan_fix_project_3c282d25 (db_path, project_path);
+        status = hyscan_fix_project_3c282d25 (&params);
 
     case HYSCAN_FIX_PROJECT_7F9EB90C:
       if (status)
-        status = hyscan_fix_project_7f9eb90c (db_path, project_path);
+        status = hyscan_fix_project_7f9eb90c (&params);
 
     case HYSCAN_FIX_PROJECT_FD8E8922:
       if (status)
-        status = hyscan_fix_project_fd8e8922 (db_path, project_path);
+        status = hyscan_fix_project_fd8e8922 (&params);
 
     case HYSCAN_FIX_PROJECT_DE7491C1:
       if (status)
-        status = hyscan_fix_project_de7491c1 (db_path, project_path);
+        status = hyscan_fix_project_de7491c1 (&params);
 
     case HYSCAN_FIX_PROJECT_AD1F40A3:
       if (status)
-        status = hyscan_fix_project_ad1f40a3 (db_path, project_path);
+        status = hyscan_fix_project_ad1f40a3 (&params);
 
     case HYSCAN_FIX_PROJECT_B288BA04:
       if (status)
-        status = hyscan_fix_project_b288ba04 (db_path, project_path);
+        status = hyscan_fix_project_b288ba04 (&params);
 
     case HYSCAN_FIX_PROJECT_C95A6F48:
       if (status)
-        status = hyscan_fix_project_c95a6f48 (db_path, project_path);
+        status = hyscan_fix_project_c95a6f48 (&params);
 
-    case HYSCAN_FIX_PROJECT_8C1D17C8:
-      break;
-
-    case HYSCAN_FIX_PROJECT_LAST:
-      status = FALSE;
+    default:
       break;
     }
 
+  if (!status)
+    goto exit;
+
+  status = FALSE;
+
+  /* Записываем изменённые параметры. */
+  if (!hyscan_fix_project_params_commit (&params))
+    goto exit;
+
+  /* Обновление схемы параметров проекта. */
+  if (!hyscan_fix_project_set_schema (db_path, project_path, HYSCAN_FIX_PROJECT_LATEST))
+    goto exit;
+
+  /* Уборка. */
+  status = hyscan_fix_cleanup (db_path);
+
+exit:
+  hyscan_fix_project_params_clear (&params);
+
+  return status;
+}
+
+/**
+ * hyscan_fix_project:
+ * @db_path: путь к базе данных (каталог с проектами)
+ * @project_path: путь к проекту относительно db_path
+ *
+ * Функция обновляет формат данных параметров проекта. При этом
+ * происходит последовательное обновление формата данных от одной
+ * версии к другой, до текущей используемой в HyScan.
+ *
+ * Журналы обновления проекта хранятся в его каталоге и не зависят
+ * от журналов других проектов и галсов.
+ *
+ * Returns: %TRUE если обновление успешно завершено, иначе %FALSE.
+ */
+gboolean
+hyscan_fix_project (const gchar *db_path,
+                    const gchar *project_path)
+{
+  gboolean status;
+  gchar *project_root;
+
+  /* Пути к файлам проекта указываются относительно его каталога. */
+  project_root = g_build_filename (db_path, project_path, NULL);
+  status = hyscan_fix_project_upgrade (project_root, "");
+  hyscan_fix_journal_close (project_root);
+  g_free (project_root);
+
   return status;
 }
@@ -36,6 +36,7 @@
 #define __HYSCAN_FIX_PROJECT_H__
 
 #include <hyscan-types.h>
+#include "hyscan-fix-common.h"
 
 G_BEGIN_DECLS
 
@@ -59,11 +60,17 @@ typedef enum
   HYSCAN_FIX_PROJECT_LAST
 } HyScanFixProjectVersion;
 
-HyScanFixProjectVersion  hyscan_fix_project_get_version  (const gchar *db_path,
-                                                          const gchar *project_path);
+HyScanFixProjectVersion  hyscan_fix_project_probe_version (const gchar             *db_path,
+                                                           const gchar             *project_path);
 
-gboolean                 hyscan_fix_project              (const gchar *db_path,
-                                                          const gchar *project_path);
+
+gboolean                 hyscan_fix_project_estimate      (const gchar             *db_path,
+                                                           const gchar             *project_path,
+                                                           HyScanFixProjectVersion  version,
+                                                           HyScanFixCost           *cost);
+
+gboolean                 hyscan_fix_project               (const gchar             *db_path,
+                                                           const gchar             *project_path);
 
 G_END_DECLS
 
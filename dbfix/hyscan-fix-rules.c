@@ -0,0 +1,806 @@
+/* hyscan-fix-rules.c
+ *
+ * Copyright 2020 Screen LLC, Andrei Fadeev <andrei@webcontrol.ru>
+ *
+ * This file is part of HyScan DBFix.
+ *
+ * HyScan DBFix is dual-licensed: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HyScan DBFix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Alternatively, you can license this code under a commercial license.
+ * Contact the Screen LLC in this case - <info@screen-co.ru>.
+ */
+
+/* HyScan DBFix имеет двойную лицензию.
+ *
+ * Во-первых, вы можете распространять HyScan DBFix на условиях Стандартной
+ * Общественной Лицензии GNU версии 3, либо по любой более поздней версии
+ * лицензии (по вашему выбору). Полные положения лицензии GNU приведены в
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Во-вторых, этот программный код можно использовать по коммерческой
+ * лицензии. Для этого свяжитесь с ООО Экран - <info@screen-co.ru>.
+ */
+
+/* Правила преобразования параметров.
+ *
+ * Большинство шагов обновления параметров переименовывают ключи и
+ * преобразуют их значения, а остальные ключи копируют без изменений.
+ * Такие шаги описываются таблицами правил HyScanFixRule. При первом
+ * использовании таблица компилируется в хэш-таблицу по исходному ключу,
+ * после чего каждый файл параметров преобразуется за один проход, а
+ * выбор правила для ключа не зависит от числа правил.
+ *
+ * Большие файлы, например параметры меток, можно преобразовать функцией
+ * #hyscan_fix_rules_stream без загрузки в #GKeyFile. Файл читается и
+ * записывается построчно через буферы фиксированного размера, поэтому
+ * объём используемой памяти не зависит от размера файла.
+ */
+
+#include "hyscan-fix-rules.h"
+#include "hyscan-fix-common.h"
+
+#include <glib/gstdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#ifdef G_OS_WIN32
+#include <io.h>
+#define fsync _commit
+#else
+#include <unistd.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#define STREAM_BUFFER_SIZE     (64 * 1024)             /* Размер буферов потокового преобразования. */
+
+/* Скомпилированные правила. */
+typedef struct
+{
+  GHashTable          *keys;               /* Правила преобразования по исходному ключу. */
+  GPtrArray           *defaults;           /* Правила добавления ключей. */
+} HyScanFixRulesCompiled;
+
+/* Функция компилирует таблицу правил. Скомпилированные правила
+ * используются до завершения программы и не освобождаются. */
+static HyScanFixRulesCompiled *
+hyscan_fix_rules_compile (const HyScanFixRule *rules,
+                          guint                n_rules)
+{
+  HyScanFixRulesCompiled *compiled;
+  guint i;
+
+  compiled = g_new0 (HyScanFixRulesCompiled, 1);
+  compiled->keys = g_hash_table_new (g_str_hash, g_str_equal);
+  compiled->defaults = g_ptr_array_new ();
+
+  for (i = 0; i < n_rules; i++)
+    {
+      if (rules[i].type == HYSCAN_FIX_RULE_DEFAULT)
+        g_ptr_array_add (compiled->defaults, (gpointer)&rules[i]);
+      else
+        g_hash_table_insert (compiled->keys, (gpointer)rules[i].key, (gpointer)&rules[i]);
+    }
+
+  return compiled;
+}
+
+/* Этап потокового преобразования - один набор правил. */
+typedef struct
+{
+  HyScanFixRulesCompiled *compiled;        /* Скомпилированные правила. */
+  GHashTable             *keys;            /* Ключи, записанные в текущую группу. */
+  gchar                  *schema_id;       /* Схема текущей группы. */
+} HyScanFixRulesStage;
+
+/* Состояние потокового преобразования. */
+typedef struct
+{
+  HyScanFixRulesStage    *stages;          /* Этапы преобразования. */
+  guint                   n_stages;        /* Число этапов. */
+  gboolean                in_group;        /* Признак открытой группы. */
+  guint                   n_blank;         /* Число отложенных пустых строк. */
+  GString                *out;             /* Буфер записи. */
+  gint                    fd;              /* Дескриптор выходного файла. */
+  gboolean                error;           /* Признак ошибки записи. */
+  gboolean                changed;         /* Признак изменения параметров. */
+} HyScanFixRulesStream;
+
+/* Функция возвращает скомпилированные правила, компилируя их при первом
+ * обращении. Функция может вызываться из разных потоков. */
+static HyScanFixRulesCompiled *
+hyscan_fix_rules_get_compiled (HyScanFixRules *rules)
+{
+  if (g_once_init_enter (&rules->compiled))
+    g_once_init_leave (&rules->compiled, (gsize)hyscan_fix_rules_compile (rules->rules, rules->n_rules));
+
+  return (HyScanFixRulesCompiled *)rules->compiled;
+}
+
+/* Функция копирует значение ключа, считывая и записывая его как значение
+ * указанного типа. Строковые значения копируются без преобразования. */
+static void
+hyscan_fix_rules_copy (GKeyFile           *params_in,
+                       GKeyFile           *params_out,
+                       const gchar        *group,
+                       const gchar        *key,
+                       const gchar        *new_key,
+                       HyScanFixValueType  value_type)
+{
+  switch (value_type)
+    {
+    case HYSCAN_FIX_VALUE_INTEGER:
+      g_key_file_set_integer (params_out, group, new_key,
+                              g_key_file_get_integer (params_in, group, key, NULL));
+      break;
+
+    case HYSCAN_FIX_VALUE_INT64:
+      g_key_file_set_int64 (params_out, group, new_key,
+                            g_key_file_get_int64 (params_in, group, key, NULL));
+      break;
+
+    case HYSCAN_FIX_VALUE_DOUBLE:
+      g_key_file_set_double (params_out, group, new_key,
+                             g_key_file_get_double (params_in, group, key, NULL));
+      break;
+
+    /* Строки переносятся в том виде, в котором они записаны в файле,
+     * без обработки экранированных символов, поэтому значение
+     * сохраняется побайтно. */
+    default:
+      {
+        gchar *value = g_key_file_get_value (params_in, group, key, NULL);
+
+        if (value != NULL)
+          g_key_file_set_value (params_out, group, new_key, value);
+        g_free (value);
+      }
+    }
+}
+
+/* Функция заменяет значение ключа по таблице. */
+static void
+hyscan_fix_rules_map (const HyScanFixRule *rule,
+                      GKeyFile            *params_in,
+                      GKeyFile            *params_out,
+                      const gchar         *group,
+                      const gchar         *key,
+                      const gchar         *new_key)
+{
+  const gchar *mapped = rule->value;
+  gchar *value;
+  guint i;
+
+  if (rule->value_type == HYSCAN_FIX_VALUE_INTEGER)
+    value = g_strdup_printf ("%d", g_key_file_get_integer (params_in, group, key, NULL));
+  else if (rule->value_type == HYSCAN_FIX_VALUE_INT64)
+    value = g_strdup_printf ("%" G_GINT64_FORMAT, g_key_file_get_int64 (params_in, group, key, NULL));
+  else
+    value = g_key_file_get_string (params_in, group, key, NULL);
+
+  for (i = 0; (value != NULL) && (rule->values[i].from != NULL); i++)
+    {
+      if (strcmp (rule->values[i].from, value) == 0)
+        {
+          mapped = rule->values[i].to;
+          break;
+        }
+    }
+
+  if (mapped != NULL)
+    g_key_file_set_string (params_out, group, new_key, mapped);
+
+  g_free (value);
+}
+
+/* Функция преобразует ключ по правилу. */
+static void
+hyscan_fix_rules_apply_rule (const HyScanFixRule *rule,
+                             GKeyFile            *params_in,
+                             GKeyFile            *params_out,
+                             const gchar         *group,
+                             const gchar         *key)
+{
+  const gchar *new_key = (rule->new_key != NULL) ? rule->new_key : key;
+  gdouble value;
+
+  switch (rule->type)
+    {
+    case HYSCAN_FIX_RULE_NEGATE:
+      value = g_key_file_get_double (params_in, group, key, NULL);
+      g_key_file_set_double (params_out, group, new_key, -value);
+      break;
+
+    case HYSCAN_FIX_RULE_SCALE:
+      value = g_key_file_get_double (params_in, group, key, NULL);
+      g_key_file_set_double (params_out, group, new_key, value / rule->scale);
+      break;
+
+    case HYSCAN_FIX_RULE_ENUM_MAP:
+      hyscan_fix_rules_map (rule, params_in, params_out, group, key, new_key);
+      break;
+
+    default:
+      hyscan_fix_rules_copy (params_in, params_out, group, key, new_key, rule->value_type);
+    }
+}
+
+/* Функция добавляет в группу отсутствующие ключи со значениями
+ * по умолчанию. */
+static void
+hyscan_fix_rules_apply_defaults (GPtrArray   *defaults,
+                                 GKeyFile    *params_in,
+                                 GKeyFile    *params_out,
+                                 const gchar *group)
+{
+  gchar *schema_id;
+  guint i;
+
+  if (defaults->len == 0)
+    return;
+
+  schema_id = g_key_file_get_string (params_in, group, "schema-id", NULL);
+
+  for (i = 0; i < defaults->len; i++)
+    {
+      const HyScanFixRule *rule = defaults->pdata[i];
+
+      if ((rule->schema_id != NULL) && (g_strcmp0 (rule->schema_id, schema_id) != 0))
+        continue;
+
+      if (!g_key_file_has_key (params_out, group, rule->key, NULL))
+        g_key_file_set_string (params_out, group, rule->key, rule->value);
+    }
+
+  g_free (schema_id);
+}
+
+/**
+ * hyscan_fix_rules_apply:
+ * @rules: набор правил
+ * @params: исходные параметры
+ *
+ * Функция преобразует параметры по набору правил. Ключи, для которых
+ * нет правил, копируются без изменений.
+ *
+ * Returns: (transfer full): Преобразованные параметры.
+ * Для удаления #g_key_file_unref.
+ */
+GKeyFile *
+hyscan_fix_rules_apply (HyScanFixRules *rules,
+                        GKeyFile       *params)
+{
+  HyScanFixRulesCompiled *compiled;
+  GKeyFile *params_out;
+  gchar **groups;
+  guint i, j;
+
+  compiled = hyscan_fix_rules_get_compiled (rules);
+
+  params_out = g_key_file_new ();
+  groups = g_key_file_get_groups (params, NULL);
+
+  for (i = 0; groups != NULL && groups[i] != NULL; i++)
+    {
+      gchar **keys = g_key_file_get_keys (params, groups[i], NULL, NULL);
+
+      for (j = 0; keys != NULL && keys[j] != NULL; j++)
+        {
+          const HyScanFixRule *rule = g_hash_table_lookup (compiled->keys, keys[j]);
+
+          if (rule != NULL)
+            hyscan_fix_rules_apply_rule (rule, params, params_out, groups[i], keys[j]);
+          else
+            hyscan_fix_rules_copy (params, params_out, groups[i], keys[j], keys[j], HYSCAN_FIX_VALUE_STRING);
+        }
+
+      hyscan_fix_rules_apply_defaults (compiled->defaults, params, params_out, groups[i]);
+
+      g_strfreev (keys);
+    }
+
+  g_strfreev (groups);
+
+  return params_out;
+}
+
+/* Функция разбирает целое число так же, как #GKeyFile. При ошибке
+ * возвращается ноль. */
+static gint64
+hyscan_fix_rules_parse_int (const gchar *value)
+{
+  gchar *end;
+  gint64 number;
+
+  number = g_ascii_strtoll (value, &end, 10);
+  if ((end == value) || ((*end != '\0') && !g_ascii_isspace (*end)))
+    return 0;
+
+  return number;
+}
+
+/* Функция разбирает число с плавающей точкой так же, как #GKeyFile.
+ * При ошибке возвращается ноль. */
+static gdouble
+hyscan_fix_rules_parse_double (const gchar *value)
+{
+  gchar *end;
+  gdouble number;
+
+  number = g_ascii_strtod (value, &end);
+  if ((end == value) || (*end != '\0'))
+    return 0.0;
+
+  return number;
+}
+
+/* Функция преобразует значение ключа по правилу. Значение передаётся
+ * в том виде, в котором оно записано в файле. Числа записываются в buffer
+ * так же, как их записывает #GKeyFile. Строки копируются без изменений,
+ * поэтому значения из таблиц замены не должны требовать экранирования.
+ * Если ключ должен быть удалён, возвращается NULL. */
+static const gchar *
+hyscan_fix_rules_convert (const HyScanFixRule *rule,
+                          const gchar         *value,
+                          gchar               *buffer)
+{
+  guint i;
+
+  switch (rule->type)
+    {
+    case HYSCAN_FIX_RULE_NEGATE:
+      return g_ascii_dtostr (buffer, G_ASCII_DTOSTR_BUF_SIZE, -hyscan_fix_rules_parse_double (value));
+
+    case HYSCAN_FIX_RULE_SCALE:
+      return g_ascii_dtostr (buffer, G_ASCII_DTOSTR_BUF_SIZE, hyscan_fix_rules_parse_double (value) / rule->scale);
+
+    default:
+      break;
+    }
+
+  switch (rule->value_type)
+    {
+    case HYSCAN_FIX_VALUE_INTEGER:
+      g_snprintf (buffer, G_ASCII_DTOSTR_BUF_SIZE, "%d", (gint)hyscan_fix_rules_parse_int (value));
+      break;
+
+    case HYSCAN_FIX_VALUE_INT64:
+      g_snprintf (buffer, G_ASCII_DTOSTR_BUF_SIZE, "%" G_GINT64_FORMAT, hyscan_fix_rules_parse_int (value));
+      break;
+
+    case HYSCAN_FIX_VALUE_DOUBLE:
+      g_ascii_dtostr (buffer, G_ASCII_DTOSTR_BUF_SIZE, hyscan_fix_rules_parse_double (value));
+      break;
+
+    default:
+      break;
+    }
+
+  /* Значение может находиться в buffer после предыдущего этапа,
+   * поэтому строки в него не копируются. */
+  if (rule->value_type != HYSCAN_FIX_VALUE_STRING)
+    value = buffer;
+
+  if (rule->type != HYSCAN_FIX_RULE_ENUM_MAP)
+    return value;
+
+  for (i = 0; rule->values[i].from != NULL; i++)
+    {
+      if (strcmp (rule->values[i].from, value) == 0)
+        return rule->values[i].to;
+    }
+
+  return rule->value;
+}
+
+/* Функция записывает накопленные данные в выходной файл. */
+static void
+hyscan_fix_rules_stream_flush (HyScanFixRulesStream *stream)
+{
+  const gchar *data = stream->out->str;
+  gsize size = stream->out->len;
+
+  while (!stream->error && (size > 0))
+    {
+      gssize written = write (stream->fd, data, size);
+
+      if (written < 0)
+        {
+          if (errno != EINTR)
+            stream->error = TRUE;
+          continue;
+        }
+
+      data += written;
+      size -= written;
+    }
+
+  g_string_truncate (stream->out, 0);
+}
+
+/* Функция добавляет строку в буфер записи. Пустые строки откладываются
+ * до следующей непустой строки, чтобы ключи по умолчанию добавлялись
+ * в конец группы, а не после разделяющих группы пустых строк. */
+static void
+hyscan_fix_rules_stream_line (HyScanFixRulesStream *stream,
+                              const gchar          *key,
+                              const gchar          *value)
+{
+  /* При проверке параметры никуда не записываются. */
+  if (stream->out == NULL)
+    return;
+
+  for (; stream->n_blank > 0; stream->n_blank--)
+    g_string_append_c (stream->out, '\n');
+
+  g_string_append (stream->out, key);
+  if (value != NULL)
+    {
+      g_string_append_c (stream->out, '=');
+      g_string_append (stream->out, value);
+    }
+  g_string_append_c (stream->out, '\n');
+
+  if (stream->out->len >= STREAM_BUFFER_SIZE)
+    hyscan_fix_rules_stream_flush (stream);
+}
+
+/* Функция последовательно преобразует ключ этапами, начиная с stage,
+ * и записывает результат в выходной файл. */
+static void
+hyscan_fix_rules_stream_key (HyScanFixRulesStream *stream,
+                             guint                 stage,
+                             const gchar          *key,
+                             const gchar          *value)
+{
+  gchar buffer[G_ASCII_DTOSTR_BUF_SIZE];
+
+  for (; stage < stream->n_stages; stage++)
+    {
+      HyScanFixRulesStage *current = &stream->stages[stage];
+      gboolean has_defaults = (current->compiled->defaults->len > 0);
+      const HyScanFixRule *rule;
+
+      if (has_defaults && (strcmp (key, "schema-id") == 0))
+        {
+          g_free (current->schema_id);
+          current->schema_id = g_strdup (value);
+        }
+
+      rule = g_hash_table_lookup (current->compiled->keys, key);
+      if (rule != NULL)
+        {
+          stream->changed = TRUE;
+
+          value = hyscan_fix_rules_convert (rule, value, buffer);
+          if (value == NULL)
+            return;
+
+          if (rule->new_key != NULL)
+            key = rule->new_key;
+        }
+
+      /* Записанные ключи нужны только для добавления ключей по умолчанию. */
+      if (has_defaults)
+        g_hash_table_add (current->keys, g_strdup (key));
+    }
+
+  hyscan_fix_rules_stream_line (stream, key, value);
+}
+
+/* Функция завершает текущую группу: добавляет в неё отсутствующие
+ * ключи со значениями по умолчанию и очищает состояние этапов. */
+static void
+hyscan_fix_rules_stream_group_end (HyScanFixRulesStream *stream)
+{
+  guint n_blank = stream->n_blank;
+  guint i, j;
+
+  stream->n_blank = 0;
+
+  for (i = 0; i < stream->n_stages; i++)
+    {
+      HyScanFixRulesStage *current = &stream->stages[i];
+      GPtrArray *defaults = current->compiled->defaults;
+
+      for (j = 0; stream->in_group && (j < defaults->len); j++)
+        {
+          const HyScanFixRule *rule = defaults->pdata[j];
+
+          if ((rule->schema_id != NULL) && (g_strcmp0 (rule->schema_id, current->schema_id) != 0))
+            continue;
+
+          if (g_hash_table_contains (current->keys, rule->key))
+            continue;
+
+          stream->changed = TRUE;
+          g_hash_table_add (current->keys, g_strdup (rule->key));
+          hyscan_fix_rules_stream_key (stream, i + 1, rule->key, rule->value);
+        }
+
+      g_hash_table_remove_all (current->keys);
+      g_clear_pointer (&current->schema_id, g_free);
+    }
+
+  stream->n_blank = n_blank;
+}
+
+/* Функция обрабатывает строку исходного файла. Строки, не являющиеся
+ * ключами, переносятся без изменений. */
+static void
+hyscan_fix_rules_stream_parse (HyScanFixRulesStream *stream,
+                               GString              *line)
+{
+  gchar *key, *value, *end;
+
+  /* Файлы могли быть записаны в Windows. */
+  if ((line->len > 0) && (line->str[line->len - 1] == '\r'))
+    g_string_truncate (line, line->len - 1);
+
+  key = line->str;
+  while (g_ascii_isspace (*key))
+    key++;
+
+  if (*key == '\0')
+    {
+      stream->n_blank += 1;
+      return;
+    }
+
+  if (*key == '[')
+    {
+      hyscan_fix_rules_stream_group_end (stream);
+      stream->in_group = TRUE;
+    }
+
+  value = strchr (key, '=');
+  if ((*key == '#') || (*key == '[') || (value == NULL))
+    {
+      hyscan_fix_rules_stream_line (stream, line->str, NULL);
+      return;
+    }
+
+  /* Пробелы вокруг ключа и перед значением не сохраняются,
+   * как и при разборе #GKeyFile. */
+  for (end = value; (end > key) && g_ascii_isspace (*(end - 1)); end--);
+  *end = '\0';
+
+  for (value++; g_ascii_isspace (*value); value++);
+
+  hyscan_fix_rules_stream_key (stream, 0, key, value);
+}
+
+/* Функция подготавливает этапы потокового преобразования. */
+static void
+hyscan_fix_rules_stream_init (HyScanFixRulesStream  *stream,
+                              HyScanFixRules       **rules,
+                              guint                  n_rules)
+{
+  guint i;
+
+  memset (stream, 0, sizeof (*stream));
+  stream->fd = -1;
+  stream->n_stages = n_rules;
+  stream->stages = g_new0 (HyScanFixRulesStage, n_rules);
+  for (i = 0; i < n_rules; i++)
+    {
+      stream->stages[i].compiled = hyscan_fix_rules_get_compiled (rules[i]);
+      stream->stages[i].keys = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    }
+}
+
+/* Функция освобождает этапы потокового преобразования. */
+static void
+hyscan_fix_rules_stream_clear (HyScanFixRulesStream *stream)
+{
+  guint i;
+
+  for (i = 0; i < stream->n_stages; i++)
+    {
+      g_hash_table_unref (stream->stages[i].keys);
+      g_free (stream->stages[i].schema_id);
+    }
+  g_free (stream->stages);
+
+  if (stream->out != NULL)
+    g_string_free (stream->out, TRUE);
+}
+
+/* Функция читает исходный файл и передаёт его строки этапам
+ * преобразования. При проверке чтение прекращается на первом
+ * изменении. Если файл не обязан существовать (exist равен FALSE),
+ * отсутствующий файл считается пустым. */
+static gboolean
+hyscan_fix_rules_stream_read (HyScanFixRulesStream *stream,
+                              const gchar          *src_file,
+                              gboolean              exist)
+{
+  gboolean status = FALSE;
+  gchar *buffer = NULL;
+  GString *line = NULL;
+  gint src_fd;
+  gssize size;
+
+  src_fd = g_open (src_file, O_RDONLY | O_BINARY, 0);
+  if (src_fd < 0)
+    return !exist && (errno == ENOENT);
+
+  buffer = g_malloc (STREAM_BUFFER_SIZE);
+  line = g_string_sized_new (256);
+
+  /* Строка может переходить через границу буфера чтения, поэтому
+   * она накапливается отдельно до символа перевода строки. */
+  while (!stream->error && ((stream->out != NULL) || !stream->changed))
+    {
+      gchar *data, *end;
+
+      size = read (src_fd, buffer, STREAM_BUFFER_SIZE);
+      if ((size < 0) && (errno == EINTR))
+        continue;
+      if (size < 0)
+        goto exit;
+      if (size == 0)
+        break;
+
+      for (data = buffer; data < buffer + size; data = end + 1)
+        {
+          end = memchr (data, '\n', buffer + size - data);
+          if (end == NULL)
+            {
+              g_string_append_len (line, data, buffer + size - data);
+              break;
+            }
+
+          g_string_append_len (line, data, end - data);
+          hyscan_fix_rules_stream_parse (stream, line);
+          g_string_truncate (line, 0);
+        }
+    }
+
+  if (line->len > 0)
+    hyscan_fix_rules_stream_parse (stream, line);
+
+  hyscan_fix_rules_stream_group_end (stream);
+
+  status = TRUE;
+
+exit:
+  close (src_fd);
+  g_string_free (line, TRUE);
+  g_free (buffer);
+
+  return status;
+}
+
+/**
+ * hyscan_fix_rules_check:
+ * @rules: (array length=n_rules): наборы правил
+ * @n_rules: число наборов правил
+ * @src_file: путь к файлу параметров
+ *
+ * Функция проверяет, изменит ли #hyscan_fix_rules_stream файл параметров.
+ * Файл только читается, проверка прекращается на первом ключе, к которому
+ * применяется правило, или на первом добавляемом ключе. Отсутствующий
+ * файл не изменяется. Повторяющиеся группы и ключи обрабатываются так же,
+ * как в #hyscan_fix_rules_stream, поэтому для таких файлов результат
+ * проверки может не соответствовать #hyscan_fix_rules_apply.
+ *
+ * Returns: %TRUE если файл будет изменён или его не удалось прочитать,
+ * %FALSE если преобразование файл не изменит.
+ */
+gboolean
+hyscan_fix_rules_check (HyScanFixRules **rules,
+                        guint            n_rules,
+                        const gchar     *src_file)
+{
+  HyScanFixRulesStream stream;
+  gboolean changed;
+
+  hyscan_fix_rules_stream_init (&stream, rules, n_rules);
+
+  changed = !hyscan_fix_rules_stream_read (&stream, src_file, FALSE) || stream.changed;
+
+  hyscan_fix_rules_stream_clear (&stream);
+
+  return changed;
+}
+
+/**
+ * hyscan_fix_rules_stream:
+ * @rules: (array length=n_rules): наборы правил
+ * @n_rules: число наборов правил
+ * @src_file: путь к исходному файлу параметров
+ * @dst_file: путь к преобразованному файлу параметров
+ *
+ * Функция преобразует файл параметров последовательно всеми наборами
+ * правил без загрузки в #GKeyFile. Порядок строк и комментарии
+ * сохраняются.
+ *
+ * Для файлов без повторяющихся групп и ключей результат совпадает
+ * с вызовами #hyscan_fix_rules_apply для каждого набора правил. В отличие
+ * от #GKeyFile, повторения не объединяются: каждый заголовок группы
+ * обрабатывается как отдельная группа, и ключи по умолчанию добавляются
+ * в каждую из них, а каждый повторный ключ преобразуется и записывается
+ * отдельной строкой.
+ *
+ * Преобразованные параметры записываются во временный файл, который
+ * затем заменяет @dst_file, поэтому @src_file и @dst_file могут
+ * совпадать.
+ * Исходный файл должен существовать, иначе @dst_file не изменяется
+ * и функция завершается с ошибкой.
+ *
+ * Returns: %TRUE если преобразование выполнено, иначе %FALSE.
+ */
+gboolean
+hyscan_fix_rules_stream (HyScanFixRules **rules,
+                         guint            n_rules,
+                         const gchar     *src_file,
+                         const gchar     *dst_file)
+{
+  HyScanFixRulesStream stream;
+  gboolean status = FALSE;
+  gchar *temp = NULL;
+  GStatBuf info;
+
+  hyscan_fix_rules_stream_init (&stream, rules, n_rules);
+
+  /* Временный файл создаётся заново с правами доступа исходного файла,
+   * так как он заменяет собой файл параметров. */
+  if (g_stat (src_file, &info) != 0)
+    goto exit;
+
+  temp = g_strdup_printf ("%s.tmp", dst_file);
+  g_unlink (temp);
+  stream.fd = g_open (temp, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, info.st_mode & 0777);
+  if (stream.fd < 0)
+    goto exit;
+
+  stream.out = g_string_sized_new (2 * STREAM_BUFFER_SIZE);
+
+  if (!hyscan_fix_rules_stream_read (&stream, src_file, TRUE))
+    goto exit;
+
+  for (; stream.n_blank > 0; stream.n_blank--)
+    g_string_append_c (stream.out, '\n');
+
+  hyscan_fix_rules_stream_flush (&stream);
+  if (stream.error)
+    goto exit;
+
+  if ((hyscan_fix_journal_get_mode () != HYSCAN_FIX_FLUSH_NONE) && (fsync (stream.fd) != 0))
+    goto exit;
+
+  if (close (stream.fd) != 0)
+    {
+      stream.fd = -1;
+      goto exit;
+    }
+  stream.fd = -1;
+
+  status = (g_rename (temp, dst_file) == 0);
+
+exit:
+  if (stream.fd >= 0)
+    close (stream.fd);
+  if (!status && (temp != NULL))
+    g_unlink (temp);
+
+  hyscan_fix_rules_stream_clear (&stream);
+  g_free (temp);
+
+  return status;
+}
@@ -0,0 +1,134 @@
+/* hyscan-fix-rules.h
+ *
+ * Copyright 2020 Screen LLC, Andrei Fadeev <andrei@webcontrol.ru>
+ *
+ * This file is part of HyScan DBFix.
+ *
+ * HyScan DBFix is dual-licensed: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HyScan DBFix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Alternatively, you can license this code under a commercial license.
+ * Contact the Screen LLC in this case - <info@screen-co.ru>.
+ */
+
+/* HyScan DBFix имеет двойную лицензию.
+ *
+ * Во-первых, вы можете распространять HyScan DBFix на условиях Стандартной
+ * Общественной Лицензии GNU версии 3, либо по любой более поздней версии
+ * лицензии (по вашему выбору). Полные положения лицензии GNU приведены в
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Во-вторых, этот программный код можно использовать по коммерческой
+ * лицензии. Для этого свяжитесь с ООО Экран - <info@screen-co.ru>.
+ */
+
+
+#ifndef __HYSCAN_FIX_RULES_H__
+#define __HYSCAN_FIX_RULES_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Типы правил. */
+typedef enum
+{
+  HYSCAN_FIX_RULE_RENAME,                      /* Переименование ключа. */
+  HYSCAN_FIX_RULE_NEGATE,                      /* Инвертирование знака числа. */
+  HYSCAN_FIX_RULE_SCALE,                       /* Деление числа на коэффициент. */
+  HYSCAN_FIX_RULE_ENUM_MAP,                    /* Замена значения по таблице. */
+  HYSCAN_FIX_RULE_DEFAULT                      /* Добавление отсутствующего ключа. */
+} HyScanFixRuleType;
+
+/* Типы значений, определяющие способ чтения и записи значения. */
+typedef enum
+{
+  HYSCAN_FIX_VALUE_STRING,                     /* Строка. */
+  HYSCAN_FIX_VALUE_INTEGER,                    /* Целое число. */
+  HYSCAN_FIX_VALUE_INT64,                      /* 64-битное целое число. */
+  HYSCAN_FIX_VALUE_DOUBLE                      /* Число с плавающей точкой. */
+} HyScanFixValueType;
+
+/* Элемент таблицы замены значений. Таблица завершается элементом
+ * со значением from равным NULL. */
+typedef struct
+{
+  const gchar         *from;                   /* Исходное значение. */
+  const gchar         *to;                     /* Новое значение. */
+} HyScanFixRuleEnum;
+
+/* Правило преобразования ключа. */
+typedef struct
+{
+  HyScanFixRuleType         type;              /* Тип правила. */
+  HyScanFixValueType        value_type;        /* Тип значения. */
+  const gchar              *key;               /* Исходный ключ. */
+  const gchar              *new_key;           /* Новый ключ или NULL, если ключ не изменяется. */
+  gdouble                   scale;             /* Делитель для HYSCAN_FIX_RULE_SCALE. */
+  const HyScanFixRuleEnum  *values;            /* Таблица замены для HYSCAN_FIX_RULE_ENUM_MAP. */
+  const gchar              *schema_id;         /* Схема групп для HYSCAN_FIX_RULE_DEFAULT или NULL. */
+  const gchar              *value;             /* Значение для HYSCAN_FIX_RULE_DEFAULT или
+                                                * для отсутствующих в таблице замены значений. */
+} HyScanFixRule;
+
+/* Набор правил и его скомпилированное представление. */
+typedef struct
+{
+  const HyScanFixRule      *rules;             /* Правила. */
+  guint                     n_rules;           /* Число правил. */
+  gsize                     compiled;          /* Скомпилированные правила. */
+} HyScanFixRules;
+
+/* Правило переименования ключа с чтением и записью значения как type. */
+#define HYSCAN_FIX_RENAME(key, new_key, type) \
+  { HYSCAN_FIX_RULE_RENAME, (type), (key), (new_key), 1.0, NULL, NULL, NULL }
+
+/* Правило переименования ключа с инвертированием знака значения. */
+#define HYSCAN_FIX_NEGATE(key, new_key) \
+  { HYSCAN_FIX_RULE_NEGATE, HYSCAN_FIX_VALUE_DOUBLE, (key), (new_key), 1.0, NULL, NULL, NULL }
+
+/* Правило переименования ключа с делением значения на коэффициент,
+ * например при переводе миллиметров в метры. */
+#define HYSCAN_FIX_SCALE(key, new_key, scale) \
+  { HYSCAN_FIX_RULE_SCALE, HYSCAN_FIX_VALUE_DOUBLE, (key), (new_key), (scale), NULL, NULL, NULL }
+
+/* Правило замены значения по таблице. Значение читается как type,
+ * отсутствующее в таблице значение заменяется на fallback, а если он
+ * равен NULL, ключ удаляется. */
+#define HYSCAN_FIX_ENUM_MAP(key, new_key, type, values, fallback) \
+  { HYSCAN_FIX_RULE_ENUM_MAP, (type), (key), (new_key), 1.0, (values), NULL, (fallback) }
+
+/* Правило добавления ключа со значением по умолчанию в группы схемы
+ * schema_id, или во все группы, если schema_id равен NULL. */
+#define HYSCAN_FIX_DEFAULT(key, schema_id, value) \
+  { HYSCAN_FIX_RULE_DEFAULT, HYSCAN_FIX_VALUE_STRING, (key), NULL, 1.0, NULL, (schema_id), (value) }
+
+/* Инициализатор набора правил из статического массива. */
+#define HYSCAN_FIX_RULES(rules) \
+  { (rules), G_N_ELEMENTS (rules), 0 }
+
+GKeyFile *             hyscan_fix_rules_apply      (HyScanFixRules *rules,
+                                                    GKeyFile       *params);
+
+gboolean               hyscan_fix_rules_check      (HyScanFixRules **rules,
+                                                    guint            n_rules,
+                                                    const gchar     *src_file);
+
+gboolean               hyscan_fix_rules_stream     (HyScanFixRules **rules,
+                                                    guint            n_rules,
+                                                    const gchar     *src_file,
+                                                    const gchar     *dst_file);
+
+G_END_DECLS
+
+#endif /* __HYSCAN_FIX_RULES_H__ */
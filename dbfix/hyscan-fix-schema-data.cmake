@@ -0,0 +1,85 @@
+
+# Сценарий формирует таблицу схем данных из файлов каталога schemas.
+#
+# Имя каждого файла схемы совпадает с MD5 суммой его содержимого. Схема
+# относится к проекту, если содержит описание параметров проекта, иначе
+# к галсу. Значение версии берётся из перечислений HyScanFixProjectVersion
+# и HyScanFixTrackVersion по первым восьми символам MD5 суммы.
+#
+# Использование:
+#   cmake -DSCHEMAS_DIR=<каталог схем> -DOUTPUT=<файл> -P hyscan-fix-schema-data.cmake
+
+if (NOT SCHEMAS_DIR OR NOT OUTPUT)
+  message (FATAL_ERROR "SCHEMAS_DIR and OUTPUT must be set.")
+endif ()
+
+set (HEX "[0-9a-f]")
+set (HEX_MD5 "")
+set (HEX_ROW "")
+foreach (i RANGE 1 16)
+  set (HEX_MD5 "${HEX_MD5}${HEX}${HEX}")
+  set (HEX_ROW "${HEX_ROW}${HEX}${HEX}")
+endforeach ()
+
+file (GLOB SCHEMA_FILES RELATIVE "${SCHEMAS_DIR}" "${SCHEMAS_DIR}/*")
+list (SORT SCHEMA_FILES)
+
+set (DATA "")
+set (TABLE "")
+
+foreach (name ${SCHEMA_FILES})
+  if (name MATCHES "^${HEX_MD5}$")
+    set (file "${SCHEMAS_DIR}/${name}")
+
+    file (MD5 "${file}" md5)
+    if (NOT md5 STREQUAL name)
+      message (FATAL_ERROR "Schema ${name} checksum mismatch: ${md5}.")
+    endif ()
+
+    file (STRINGS "${file}" project_info REGEX "<schema id=\"project-info\">")
+    string (SUBSTRING "${name}" 0 8 short)
+    string (TOUPPER "${short}" version)
+    if (project_info)
+      set (type "HYSCAN_FIX_SCHEMA_PROJECT")
+      set (version "HYSCAN_FIX_PROJECT_${version}")
+    else ()
+      set (type "HYSCAN_FIX_SCHEMA_TRACK")
+      set (version "HYSCAN_FIX_TRACK_${version}")
+    endif ()
+
+    file (READ "${file}" content HEX)
+    string (LENGTH "${content}" size)
+    math (EXPR size "${size} / 2")
+
+    string (REGEX REPLACE "(${HEX_ROW})" "\\1;" rows "${content}")
+    set (bytes "")
+    foreach (row ${rows})
+      string (REGEX REPLACE "(${HEX}${HEX})" "0x\\1, " row "${row}")
+      string (STRIP "${row}" row)
+      set (bytes "${bytes}  ${row}\n")
+    endforeach ()
+
+    string (REGEX REPLACE "(${HEX}${HEX})" "0x\\1, " digest "${name}")
+    string (REGEX REPLACE ", $" "" digest "${digest}")
+
+    set (DATA "${DATA}static const guint8 schema_${short}[] =\n{\n${bytes}};\n\n")
+    set (TABLE "${TABLE}  {\n")
+    set (TABLE "${TABLE}    ${type}, ${version},\n")
+    set (TABLE "${TABLE}    \"${name}\",\n")
+    set (TABLE "${TABLE}    { ${digest} },\n")
+    set (TABLE "${TABLE}    ${size}, schema_${short}\n")
+    set (TABLE "${TABLE}  },\n")
+  endif ()
+endforeach ()
+
+set (SOURCE "/* Файл сформирован hyscan-fix-schema-data.cmake, не редактируйте его. */\n\n")
+set (SOURCE "${SOURCE}#include \"hyscan-fix-schema.h\"\n")
+set (SOURCE "${SOURCE}#include \"hyscan-fix-project.h\"\n")
+set (SOURCE "${SOURCE}#include \"hyscan-fix-track.h\"\n\n")
+set (SOURCE "${SOURCE}${DATA}")
+set (SOURCE "${SOURCE}const HyScanFixSchema hyscan_fix_schemas[] =\n{\n${TABLE}};\n\n")
+set (SOURCE "${SOURCE}const guint hyscan_fix_n_schemas = G_N_ELEMENTS (hyscan_fix_schemas);\n")
+
+file (WRITE "${OUTPUT}.tmp" "${SOURCE}")
+execute_process (COMMAND "${CMAKE_COMMAND}" -E copy_if_different "${OUTPUT}.tmp" "${OUTPUT}")
+file (REMOVE "${OUTPUT}.tmp")
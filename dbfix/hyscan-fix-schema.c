@@ -0,0 +1,195 @@
+/* hyscan-fix-schema.c
+ *
+ * Copyright 2020 Screen LLC, Andrei Fadeev <andrei@webcontrol.ru>
+ *
+ * This file is part of HyScan DBFix.
+ *
+ * HyScan DBFix is dual-licensed: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HyScan DBFix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Alternatively, you can license this code under a commercial license.
+ * Contact the Screen LLC in this case - <info@screen-co.ru>.
+ */
+
+/* HyScan DBFix имеет двойную лицензию.
+ *
+ * Во-первых, вы можете распространять HyScan DBFix на условиях Стандартной
+ * Общественной Лицензии GNU версии 3, либо по любой более поздней версии
+ * лицензии (по вашему выбору). Полные положения лицензии GNU приведены в
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Во-вторых, этот программный код можно использовать по коммерческой
+ * лицензии. Для этого свяжитесь с ООО Экран - <info@screen-co.ru>.
+ */
+
+/* Таблица схем данных.
+ *
+ * Таблица формируется при сборке сценарием hyscan-fix-schema-data.cmake из
+ * файлов каталога schemas. Для каждой схемы в таблице хранятся её тип,
+ * версия формата данных, MD5 сумма в двоичном виде, размер и содержимое.
+ *
+ * Определение версии файла схемы начинается со сравнения размера. Файлы,
+ * размер которых не совпадает ни с одной известной схемой, отбрасываются
+ * без чтения. Для остальных считается MD5 сумма, которая сравнивается с
+ * таблицей побайтно.
+ */
+
+#include "hyscan-fix-schema.h"
+#include "hyscan-fix-common.h"
+
+#include <glib/gstdio.h>
+#include <string.h>
+
+extern const HyScanFixSchema hyscan_fix_schemas[];
+extern const guint hyscan_fix_n_schemas;
+
+/* Функция преобразовывает MD5 сумму из строкового вида в двоичный. */
+static gboolean
+hyscan_fix_schema_parse_md5 (const gchar *md5,
+                             guint8      *digest)
+{
+  guint i;
+
+  if ((md5 == NULL) || (strlen (md5) != 2 * HYSCAN_FIX_SCHEMA_DIGEST_SIZE))
+    return FALSE;
+
+  for (i = 0; i < HYSCAN_FIX_SCHEMA_DIGEST_SIZE; i++)
+    {
+      gint hi = g_ascii_xdigit_value (md5[2 * i]);
+      gint lo = g_ascii_xdigit_value (md5[2 * i + 1]);
+
+      if ((hi < 0) || (lo < 0))
+        return FALSE;
+
+      digest[i] = (hi << 4) | lo;
+    }
+
+  return TRUE;
+}
+
+/* Функция ищет схему по MD5 сумме в двоичном виде. */
+static const HyScanFixSchema *
+hyscan_fix_schema_lookup (HyScanFixSchemaType  type,
+                          const guint8        *digest)
+{
+  guint i;
+
+  for (i = 0; i < hyscan_fix_n_schemas; i++)
+    {
+      const HyScanFixSchema *schema = &hyscan_fix_schemas[i];
+
+      if ((schema->type == type) &&
+          (memcmp (schema->digest, digest, HYSCAN_FIX_SCHEMA_DIGEST_SIZE) == 0))
+        {
+          return schema;
+        }
+    }
+
+  return NULL;
+}
+
+/**
+ * hyscan_fix_schema_get:
+ * @type: тип схемы
+ * @version: версия формата данных
+ *
+ * Функция возвращает описание схемы для указанной версии формата данных.
+ *
+ * Returns: (transfer none) (nullable): Описание схемы или NULL.
+ */
+const HyScanFixSchema *
+hyscan_fix_schema_get (HyScanFixSchemaType type,
+                       gint                version)
+{
+  guint i;
+
+  for (i = 0; i < hyscan_fix_n_schemas; i++)
+    {
+      if ((hyscan_fix_schemas[i].type == type) &&
+          (hyscan_fix_schemas[i].version == version))
+        {
+          return &hyscan_fix_schemas[i];
+        }
+    }
+
+  return NULL;
+}
+
+/**
+ * hyscan_fix_schema_find:
+ * @type: тип схемы
+ * @md5: MD5 сумма схемы в виде строки
+ *
+ * Функция ищет схему с указанной MD5 суммой.
+ *
+ * Returns: (transfer none) (nullable): Описание схемы или NULL.
+ */
+const HyScanFixSchema *
+hyscan_fix_schema_find (HyScanFixSchemaType  type,
+                        const gchar         *md5)
+{
+  guint8 digest[HYSCAN_FIX_SCHEMA_DIGEST_SIZE];
+
+  if (!hyscan_fix_schema_parse_md5 (md5, digest))
+    return NULL;
+
+  return hyscan_fix_schema_lookup (type, digest);
+}
+
+/**
+ * hyscan_fix_schema_detect:
+ * @type: тип схемы
+ * @db_path: путь к базе данных (каталог с проектами)
+ * @file_path: путь к файлу схемы относительно db_path
+ *
+ * Функция определяет схему, записанную в файле. Если размер файла не
+ * совпадает ни с одной известной схемой этого типа, файл не считывается.
+ *
+ * Returns: (transfer none) (nullable): Описание схемы или NULL.
+ */
+const HyScanFixSchema *
+hyscan_fix_schema_detect (HyScanFixSchemaType  type,
+                          const gchar         *db_path,
+                          const gchar         *file_path)
+{
+  guint8 digest[HYSCAN_FIX_SCHEMA_DIGEST_SIZE];
+  gboolean known_size = FALSE;
+  GStatBuf info;
+  gchar *file;
+  guint i;
+
+  file = g_build_filename (db_path, file_path, NULL);
+  if (g_stat (file, &info) != 0)
+    {
+      g_free (file);
+      return NULL;
+    }
+  g_free (file);
+
+  for (i = 0; (i < hyscan_fix_n_schemas) && !known_size; i++)
+    {
+      if ((hyscan_fix_schemas[i].type == type) &&
+          ((guint64)hyscan_fix_schemas[i].size == (guint64)info.st_size))
+        {
+          known_size = TRUE;
+        }
+    }
+
+  if (!known_size)
+    return NULL;
+
+  if (!hyscan_fix_file_digest (db_path, file_path, digest))
+    return NULL;
+
+  return hyscan_fix_schema_lookup (type, digest);
+}
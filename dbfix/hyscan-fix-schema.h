@@ -0,0 +1,92 @@
+/* hyscan-fix-schema.h
+ *
+ * Copyright 2020 Screen LLC, Andrei Fadeev <andrei@webcontrol.ru>
+ *
+ * This file is part of HyScan DBFix.
+ *
+ * HyScan DBFix is dual-licensed: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HyScan DBFix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Alternatively, you can license this code under a commercial license.
+ * Contact the Screen LLC in this case - <info@screen-co.ru>.
+ */
+
+/* HyScan DBFix имеет двойную лицензию.
+ *
+ * Во-первых, вы можете распространять HyScan DBFix на условиях Стандартной
+ * Общественной Лицензии GNU версии 3, либо по любой более поздней версии
+ * лицензии (по вашему выбору). Полные положения лицензии GNU приведены в
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Во-вторых, этот программный код можно использовать по коммерческой
+ * лицензии. Для этого свяжитесь с ООО Экран - <info@screen-co.ru>.
+ */
+
+#ifndef __HYSCAN_FIX_SCHEMA_H__
+#define __HYSCAN_FIX_SCHEMA_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define HYSCAN_FIX_SCHEMA_DIGEST_SIZE  16
+
+/**
+ * HyScanFixSchemaType:
+ * @HYSCAN_FIX_SCHEMA_PROJECT: схема параметров проекта
+ * @HYSCAN_FIX_SCHEMA_TRACK: схема параметров галса
+ *
+ * Типы схем данных.
+ */
+typedef enum
+{
+  HYSCAN_FIX_SCHEMA_PROJECT,
+  HYSCAN_FIX_SCHEMA_TRACK
+} HyScanFixSchemaType;
+
+/**
+ * HyScanFixSchema:
+ * @type: тип схемы
+ * @version: версия формата данных (#HyScanFixProjectVersion или #HyScanFixTrackVersion)
+ * @md5: MD5 сумма схемы в виде строки
+ * @digest: MD5 сумма схемы
+ * @size: размер схемы
+ * @data: содержимое схемы
+ *
+ * Описание схемы данных. Таблица схем формируется при сборке из файлов
+ * каталога schemas.
+ */
+typedef struct _HyScanFixSchema HyScanFixSchema;
+struct _HyScanFixSchema
+{
+  HyScanFixSchemaType  type;
+  gint                 version;
+  const gchar         *md5;
+  guint8               digest[HYSCAN_FIX_SCHEMA_DIGEST_SIZE];
+  gsize                size;
+  const guint8        *data;
+};
+
+const HyScanFixSchema *hyscan_fix_schema_get       (HyScanFixSchemaType  type,
+                                                    gint                 version);
+
+const HyScanFixSchema *hyscan_fix_schema_find      (HyScanFixSchemaType  type,
+                                                    const gchar         *md5);
+
+const HyScanFixSchema *hyscan_fix_schema_detect    (HyScanFixSchemaType  type,
+                                                    const gchar         *db_path,
+                                                    const gchar         *file_path);
+
+G_END_DECLS
+
+#endif /* __HYSCAN_FIX_SCHEMA_H__ */
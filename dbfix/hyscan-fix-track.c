@@ -36,51 +36,168 @@
 
 #include "hyscan-fix-track.h"
 #include "hyscan-fix-common.h"
+#include "hyscan-fix-cache.h"
+#include "hyscan-fix-key-file.h"
+#include "hyscan-fix-rules.h"
+
+#include <glib/gstdio.h>
+#include <string.h>
 
 #define TRACK_FILE_MAGIC       0x52545348      /* HSTR в виде строки. */
 #define TRACK_FILE_VERSION     0x31303731      /* 1701 в виде строки. */
 
-/* Функция возвращает значение контрольной суммы для версии схемы. */
-static const gchar *
-hyscan_fix_track_get_hash (HyScanFixTrackVersion version)
+#define SEGMENT_INDEX          (1 << 0)        /* Признак наличия индексного файла сегмента. */
+#define SEGMENT_DATA           (1 << 1)        /* Признак наличия файла данных сегмента. */
+
+/* Функция переносит файл канала данных. Файл переименовывается, а если
+ * это невозможно, копируется с возможностью отмены. Существующий целевой
+ * файл не заменяется ни переименованием, ни копированием: он может быть
+ * помечен для удаления вместе с каналом, который не переносится, и тогда
+ * перенесённые в него данные были бы удалены. В этом случае функция
+ * завершается с ошибкой. */
+static gboolean
+hyscan_fix_track_move_file (const gchar       *db_path,
+                            const gchar       *track_path,
+                            const gchar       *src_file,
+                            const gchar       *dst_file,
+                            HyScanCancellable *cancellable)
 {
-  switch (version)
+  gboolean status = FALSE;
+  gchar *src_path;
+  gchar *dst_path;
+  gchar *dst_full;
+
+  src_path = g_build_filename (track_path, src_file, NULL);
+  dst_path = g_build_filename (track_path, dst_file, NULL);
+  dst_full = g_build_filename (db_path, dst_path, NULL);
+
+  if (!g_file_test (dst_full, G_FILE_TEST_EXISTS))
     {
-    case HYSCAN_FIX_TRACK_2F9C8A44:
-      return "2f9c8a4405c52774c22fbd1e00c45ab2";
-    case HYSCAN_FIX_TRACK_19A285F3:
-      return "19a285f398b930c936df0567abf356b3";
-    case HYSCAN_FIX_TRACK_9726336A:
-      return "9726336af32731e31dd3752276981192";
-    case HYSCAN_FIX_TRACK_E8B616CC:
-      return "e8b616ccac5dab4da97444e4b93ac7f4";
-    case HYSCAN_FIX_TRACK_423880D1:
-      return "423880d10472f9465725e5d4761b32cd";
-    case HYSCAN_FIX_TRACK_49A23606:
-      return "49a23606a3160bb9e5cfdf52a8badd81";
-    case HYSCAN_FIX_TRACK_E4DA49A9:
-      return "e4da49a9e1a33f0e866996879f3cdc90";
-    case HYSCAN_FIX_TRACK_C3D0AD78:
-      return "c3d0ad780bdf897fd0758851f10e9b70";
-    default:
-      break;
+      status = hyscan_fix_file_move (db_path, src_path, dst_path, TRUE) ||
+               hyscan_fix_file_copy (db_path, src_path, dst_path, TRUE, cancellable);
     }
-  return NULL;
+
+  g_free (src_path);
+  g_free (dst_path);
+  g_free (dst_full);
+
+  return status;
 }
 
-/* Функция копирует данные канала. */
+/* Функция составляет карту сегментов каналов данных галса за один проход
+ * по каталогу. Ключом является название канала, значением - массив
+ * признаков SEGMENT_INDEX и SEGMENT_DATA для каждого номера сегмента. */
+static GHashTable *
+hyscan_fix_track_segments_new (const gchar *db_path,
+                               const gchar *track_path)
+{
+  HyScanFixDirIter *iter;
+  GHashTable *segments;
+  const gchar *name;
+  gboolean is_dir;
+  gchar *path;
+
+  path = g_build_filename (db_path, track_path, NULL);
+  iter = hyscan_fix_dir_iter_new (path);
+  g_free (path);
+
+  if (iter == NULL)
+    return NULL;
+
+  segments = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_array_unref);
+
+  /* Файлы сегментов называются <канал>.<номер из 6 цифр>.<i|d>. */
+  while (hyscan_fix_dir_iter_next (iter, &name, &is_dir))
+    {
+      gsize length = strlen (name);
+      const gchar *number;
+      GArray *flags;
+      guint8 flag;
+      guint index;
+      guint8 zero = 0;
+      gchar *channel;
+      guint i;
+
+      if (is_dir || (length < 10) || (name[length - 2] != '.') || (name[length - 9] != '.'))
+        continue;
+
+      if (name[length - 1] == 'i')
+        flag = SEGMENT_INDEX;
+      else if (name[length - 1] == 'd')
+        flag = SEGMENT_DATA;
+      else
+        continue;
+
+      number = name + length - 8;
+      for (i = 0, index = 0; i < 6 && g_ascii_isdigit (number[i]); i++)
+        index = 10 * index + (number[i] - '0');
+      if (i != 6)
+        continue;
+
+      channel = g_strndup (name, length - 9);
+      flags = g_hash_table_lookup (segments, channel);
+      if (flags == NULL)
+        {
+          flags = g_array_new (FALSE, TRUE, sizeof (guint8));
+          g_hash_table_insert (segments, channel, flags);
+        }
+      else
+        {
+          g_free (channel);
+        }
+
+      while (flags->len <= index)
+        g_array_append_val (flags, zero);
+
+      g_array_index (flags, guint8, index) |= flag;
+    }
+
+  hyscan_fix_dir_iter_free (iter);
+
+  return segments;
+}
+
+/* Функция возвращает число сегментов канала данных. Сегменты нумеруются
+ * подряд с нуля, у каждого должны быть индексный файл и файл данных. */
+static gboolean
+hyscan_fix_track_segments_count (GHashTable  *segments,
+                                 const gchar *channel,
+                                 guint32     *n_segments)
+{
+  GArray *flags = g_hash_table_lookup (segments, channel);
+  guint32 i;
+
+  for (i = 0; flags != NULL && i < flags->len; i++)
+    {
+      guint8 flag = g_array_index (flags, guint8, i);
+
+      if (flag == 0)
+        break;
+
+      if (flag != (SEGMENT_INDEX | SEGMENT_DATA))
+        return FALSE;
+    }
+
+  *n_segments = i;
+
+  return TRUE;
+}
+
+/* Функция переносит данные канала под новым названием. Файлы данных
+ * переименовываются на месте, обратные переименования сохраняются в
+ * журнале и выполняются при откате изменений. */
 static gboolean
-hyscan_fix_track_copy_channel (const gchar *db_path,
-                               const gchar *track_path,
-                               const gchar *src_channel,
-                               const gchar *dst_channel)
+hyscan_fix_track_move_channel (const gchar       *db_path,
+                               const gchar       *track_path,
+                               GHashTable        *segments,
+                               const gchar       *src_channel,
+                               const gchar       *dst_channel,
+                               HyScanCancellable *cancellable)
 {
   gboolean status = FALSE;
   gchar *src_file = NULL;
   gchar *dst_file = NULL;
-  gchar *src_path = NULL;
-  gchar *dst_path = NULL;
-  guint32 n_segments = 0;
+  guint32 n_segments;
   guint32 i;
 
   if (dst_channel == NULL)
@@ -89,73 +206,47 @@ hyscan_fix_track_copy_channel (const gchar *db_path,
   if (g_strcmp0 (src_channel, dst_channel) == 0)
     return TRUE;
 
-  /* Считаем число сегментов данных. */
-  while (TRUE)
-    {
-      gboolean has_index;
-      gboolean has_data;
-
-      src_file = g_strdup_printf ("%s.%06d.i", src_channel, n_segments);
-      src_path = g_build_filename (track_path, src_file, NULL);
-      has_index = hyscan_fix_file_exist (db_path, src_path);
-      g_clear_pointer (&src_file, g_free);
-      g_clear_pointer (&src_path, g_free);
-
-      src_file = g_strdup_printf ("%s.%06d.d", src_channel, n_segments);
-      src_path = g_build_filename (track_path, src_file, NULL);
-      has_data = hyscan_fix_file_exist (db_path, src_path);
-      g_clear_pointer (&src_file, g_free);
-      g_clear_pointer (&src_path, g_free);
-
-      if (has_index && has_data)
-        {
-          n_segments += 1;
-          continue;
-        }
-
-      if ((has_index && !has_data) || (!has_index && has_data))
-        goto exit;
-
-      break;
-    }
+  /* Число сегментов данных. */
+  if (!hyscan_fix_track_segments_count (segments, src_channel, &n_segments))
+    return FALSE;
 
-  /* Копируем файлы канала. */
+  /* Переносим файлы канала. Прогресс каждого сегмента определяется
+   * копированием файла данных, индексный файл мал. */
+  hyscan_cancellable_push (cancellable);
   for (i = 0; i < n_segments; i++)
     {
+      hyscan_cancellable_set_total (cancellable, i, 0, n_segments);
+
       src_file = g_strdup_printf ("%s.%06d.i", src_channel, i);
       dst_file = g_strdup_printf ("%s.%06d.i", dst_channel, i);
-      src_path = g_build_filename (track_path, src_file, NULL);
-      dst_path = g_build_filename (track_path, dst_file, NULL);
 
-      if (!hyscan_fix_file_copy (db_path, src_path, dst_path, TRUE))
+      if (!hyscan_fix_track_move_file (db_path, track_path, src_file, dst_file, NULL))
         goto exit;
 
       g_clear_pointer (&src_file, g_free);
       g_clear_pointer (&dst_file, g_free);
-      g_clear_pointer (&src_path, g_free);
-      g_clear_pointer (&dst_path, g_free);
 
       src_file = g_strdup_printf ("%s.%06d.d", src_channel, i);
       dst_file = g_strdup_printf ("%s.%06d.d", dst_channel, i);
-      src_path = g_build_filename (track_path, src_file, NULL);
-      dst_path = g_build_filename (track_path, dst_file, NULL);
 
-      if (!hyscan_fix_file_copy (db_path, src_path, dst_path, TRUE))
+      hyscan_cancellable_push (cancellable);
+      status = hyscan_fix_track_move_file (db_path, track_path, src_file, dst_file, cancellable);
+      hyscan_cancellable_pop (cancellable);
+
+      if (!status)
         goto exit;
 
       g_clear_pointer (&src_file, g_free);
       g_clear_pointer (&dst_file, g_free);
-      g_clear_pointer (&src_path, g_free);
-      g_clear_pointer (&dst_path, g_free);
     }
 
   status = TRUE;
 
 exit:
+  hyscan_cancellable_pop (cancellable);
+
   g_free (src_file);
   g_free (dst_file);
-  g_free (src_path);
-  g_free (dst_path);
 
   return status;
 }
@@ -164,53 +255,44 @@ exit:
 static gboolean
 hyscan_fix_track_mark_channel_remove (const gchar *db_path,
                                       const gchar *track_path,
+                                      GHashTable  *segments,
                                       const gchar *channel)
 {
-  gboolean status = FALSE;
-  gchar *file = NULL;
-  gchar *path = NULL;
-  guint32 n_segments = 0;
+  GArray *flags = g_hash_table_lookup (segments, channel);
+  gchar *file;
+  gchar *path;
+  guint32 i;
 
-  while (TRUE)
+  for (i = 0; flags != NULL && i < flags->len; i++)
     {
-      gboolean has_index;
-      gboolean has_data;
-
-      file = g_strdup_printf ("%s.%06d.i", channel, n_segments);
-      path = g_build_filename (track_path, file, NULL);
-      has_index = hyscan_fix_file_exist (db_path, path);
-      if (has_index)
-        hyscan_fix_file_mark_remove (db_path, path);
-      g_clear_pointer (&file, g_free);
-      g_clear_pointer (&path, g_free);
-
-      file = g_strdup_printf ("%s.%06d.d", channel, n_segments);
-      path = g_build_filename (track_path, file, NULL);
-      has_data = hyscan_fix_file_exist (db_path, path);
-      if (has_data)
-        hyscan_fix_file_mark_remove (db_path, path);
-      g_clear_pointer (&file, g_free);
-      g_clear_pointer (&path, g_free);
-
-      if (has_index && has_data)
+      guint8 flag = g_array_index (flags, guint8, i);
+
+      if (flag == 0)
+        break;
+
+      if (flag & SEGMENT_INDEX)
         {
-          n_segments += 1;
-          continue;
+          file = g_strdup_printf ("%s.%06d.i", channel, i);
+          path = g_build_filename (track_path, file, NULL);
+          hyscan_fix_file_mark_remove (db_path, path);
+          g_free (file);
+          g_free (path);
         }
 
-      if ((has_index && !has_data) || (!has_index && has_data))
-        goto exit;
+      if (flag & SEGMENT_DATA)
+        {
+          file = g_strdup_printf ("%s.%06d.d", channel, i);
+          path = g_build_filename (track_path, file, NULL);
+          hyscan_fix_file_mark_remove (db_path, path);
+          g_free (file);
+          g_free (path);
+        }
 
-      break;
+      if (flag != (SEGMENT_INDEX | SEGMENT_DATA))
+        return FALSE;
     }
 
-  status = TRUE;
-
-exit:
-  g_free (file);
-  g_free (path);
-
-  return status;
+  return TRUE;
 }
 
 /* Функция возвращает значение рабочей частоты канала. */
@@ -481,8 +563,9 @@ hyscan_fix_track_update_params_2f9c8a44 (GKeyFile    *src_params,
       gchar *track_type;
       gchar *sonar_data;
 
-      track_id = g_key_file_get_string (src_params, src_group, "/id", NULL);
-      track_type = g_key_file_get_string (src_params, src_group, "/type", NULL);
+      /* Идентификатор и тип галса не изменяются и переносятся как есть. */
+      track_id = g_key_file_get_value (src_params, src_group, "/id", NULL);
+      track_type = g_key_file_get_value (src_params, src_group, "/type", NULL);
       sonar_data = hyscan_fix_track_update_sonar_2f9c8a44 (src_params);
       ctime *= G_USEC_PER_SEC;
 
@@ -490,8 +573,8 @@ hyscan_fix_track_update_params_2f9c8a44 (GKeyFile    *src_params,
         goto exit;
 
       g_key_file_set_string (dst_params, dst_group, "schema-id", "track");
-      g_key_file_set_string (dst_params, dst_group, "/id", track_id);
-      g_key_file_set_string (dst_params, dst_group, "/type", track_type);
+      g_key_file_set_value (dst_params, dst_group, "/id", track_id);
+      g_key_file_set_value (dst_params, dst_group, "/type", track_type);
       g_key_file_set_string (dst_params, dst_group, "/sonar", sonar_data);
       g_key_file_set_int64 (dst_params, dst_group, "/ctime", ctime);
 
@@ -675,32 +758,48 @@ hyscan_fix_track_set_schema (const gchar           *db_path,
 
   sch_file = g_build_filename (track_path, "track.sch", NULL);
   if (hyscan_fix_file_backup (db_path, sch_file, TRUE))
-    status = hyscan_fix_file_schema (db_path, sch_file, hyscan_fix_track_get_hash (version));
+    status = hyscan_fix_file_schema (db_path, sch_file,
+                                     hyscan_fix_schema_get (HYSCAN_FIX_SCHEMA_TRACK, version));
   g_free (sch_file);
 
   return status;
 }
 
+/* Функция преобразует параметры галса по набору правил и заменяет
+ * ими исходные параметры. */
+static void
+hyscan_fix_track_apply_rules (HyScanFixRules  *rules,
+                              GKeyFile       **params)
+{
+  GKeyFile *params_out = hyscan_fix_rules_apply (rules, *params);
+
+  g_key_file_unref (*params);
+  *params = params_out;
+}
+
 /* Функция обновляет формат данных галса с версии 2f9c8a44 до 19a285f3.
  *
  * Версия 2f9c8a44 записывалась версией для испытаний АМЭ от 2017 года.
  * Это старый формат, который предполагал параллельную запись сырых и
  * обработанных данных.
  *
- * Оставляем только сырые данные.
+ * Оставляем только сырые данные. Данные каналов, у которых изменилось
+ * название, переименовываются на месте без копирования.
  */
 static gboolean
-hyscan_fix_track_2f9c8a44 (const gchar       *db_path,
-                           const gchar       *track_path,
-                           HyScanCancellable *cancellable)
+hyscan_fix_track_2f9c8a44 (const gchar        *db_path,
+                           const gchar        *track_path,
+                           GKeyFile          **params,
+                           HyScanCancellable  *cancellable)
 {
   gboolean status = FALSE;
   HyScanFixFileIDType id;
   gchar *id_path = NULL;
-  gchar *prm_file = NULL;
-  GKeyFile *src_params = NULL;
+  GKeyFile *src_params = *params;
   GKeyFile *dst_params = NULL;
+  GHashTable *segments = NULL;
   gchar **groups = NULL;
+  gboolean pushed = FALSE;
   guint i;
 
   /* Время создания галса. */
@@ -708,21 +807,15 @@ hyscan_fix_track_2f9c8a44 (const gchar       *db_path,
   id = hyscan_fix_file_db_id (db_path, id_path);
   g_free (id_path);
 
-  /* Бэкап параметров галса. */
-  prm_file = g_build_filename (track_path, "track.prm", NULL);
-  if (!hyscan_fix_file_backup (db_path, prm_file, TRUE))
+  /* Сегменты данных всех каналов галса. */
+  segments = hyscan_fix_track_segments_new (db_path, track_path);
+  if (segments == NULL)
     goto exit;
 
   /* Преобразование параметров и данных галса. */
-  g_free (prm_file);
-  prm_file = g_build_filename (db_path, track_path, "track.prm", NULL);
-
-  src_params = g_key_file_new ();
-  if (!g_key_file_load_from_file (src_params, prm_file, G_KEY_FILE_NONE, NULL))
-    goto exit;
-
   dst_params = g_key_file_new ();
   hyscan_cancellable_push (cancellable);
+  pushed = TRUE;
   groups = g_key_file_get_groups (src_params, NULL);
   for (i = 0; groups != NULL && groups[i] != NULL; i++)
     {
@@ -730,42 +823,40 @@ hyscan_fix_track_2f9c8a44 (const gchar       *db_path,
 
       hyscan_cancellable_set_total (cancellable, i, 0, g_strv_length (groups));
 
+      if (g_cancellable_is_cancelled (G_CANCELLABLE (cancellable)))
+        goto exit;
+
       /* Каналы галса. */
       channel = hyscan_fix_track_update_channel_name_2f9c8a44 (groups[i]);
       if (channel == NULL)
         {
-          hyscan_fix_track_mark_channel_remove (db_path, track_path, groups[i]);
+          hyscan_fix_track_mark_channel_remove (db_path, track_path, segments, groups[i]);
           continue;
         }
 
-      /* Копируем данные канала. */
-      if (!hyscan_fix_track_copy_channel (db_path, track_path, groups[i], channel))
+      /* Переносим данные канала. */
+      if (!hyscan_fix_track_move_channel (db_path, track_path, segments, groups[i], channel, cancellable))
         goto exit;
 
       /* Преобразовываем параметры канала. */
       if (!hyscan_fix_track_update_params_2f9c8a44 (src_params, dst_params, groups[i], channel, id.dt))
         goto exit;
     }
-  hyscan_cancellable_pop (cancellable);
-
-  /* Записываем изменённые параметры. */
-  if (!g_key_file_save_to_file (dst_params, prm_file, NULL))
-    goto exit;
 
-  /* Обновление схемы параметров галса. */
-  if (!hyscan_fix_track_set_schema (db_path, track_path, HYSCAN_FIX_TRACK_9726336A))
-    goto exit;
+  /* Заменяем параметры галса изменёнными. */
+  *params = g_steal_pointer (&dst_params);
+  g_key_file_unref (src_params);
 
-  /* Уборка. */
-  status = hyscan_fix_cleanup (db_path);
+  status = TRUE;
 
 exit:
-  g_clear_pointer (&src_params, g_key_file_unref);
+  if (pushed)
+    hyscan_cancellable_pop (cancellable);
+
   g_clear_pointer (&dst_params, g_key_file_unref);
+  g_clear_pointer (&segments, g_hash_table_unref);
   g_clear_pointer (&groups, g_strfreev);
 
-  g_free (prm_file);
-
   return status;
 }
 
@@ -784,99 +875,22 @@ exit:
  * /offset/theta -> /offset/pitch + инвертирование знака
  */
 static gboolean
-hyscan_fix_track_19a285f3 (const gchar *db_path,
-                           const gchar *track_path)
+hyscan_fix_track_19a285f3 (GKeyFile **params)
 {
-  gboolean status = FALSE;
-  gchar *prm_file = NULL;
-
-  GKeyFile *params_in = NULL;
-  GKeyFile *params_out = NULL;
-  gchar **groups = NULL;
-  guint i, j;
-
-  /* Бэкап параметров галса. */
-  prm_file = g_build_filename (track_path, "track.prm", NULL);
-  if (!hyscan_fix_file_backup (db_path, prm_file, TRUE))
-    goto exit;
-
-  /* Преобразование параметров галса. */
-  g_free (prm_file);
-  prm_file = g_build_filename (db_path, track_path, "track.prm", NULL);
-
-  params_in = g_key_file_new ();
-  if (!g_key_file_load_from_file (params_in, prm_file, G_KEY_FILE_NONE, NULL))
-    goto exit;
-
-  params_out = g_key_file_new ();
-  groups = g_key_file_get_groups (params_in, NULL);
-
-  for (i = 0; groups != NULL && groups[i] != NULL; i++)
-    {
-      gchar **keys = g_key_file_get_keys (params_in, groups[i], NULL, NULL);
-
-      for (j = 0; keys != NULL && keys[j] != NULL; j++)
-        {
-          if (g_strcmp0 (keys[j], "/offset/x") == 0)
-            {
-              gdouble forward = g_key_file_get_double (params_in, groups[i], keys[j], NULL);
-              g_key_file_set_double (params_out, groups[i], "/offset/forward", forward);
-            }
-          else if (g_strcmp0 (keys[j], "/offset/y") == 0)
-            {
-              gdouble starboard = g_key_file_get_double (params_in, groups[i], keys[j], NULL);
-              g_key_file_set_double (params_out, groups[i], "/offset/starboard", starboard);
-            }
-          else if (g_strcmp0 (keys[j], "/offset/z") == 0)
-            {
-              gdouble vertical = g_key_file_get_double (params_in, groups[i], keys[j], NULL);
-              g_key_file_set_double (params_out, groups[i], "/offset/vertical", vertical);
-            }
-          else if (g_strcmp0 (keys[j], "/offset/psi") == 0)
-            {
-              gdouble yaw = g_key_file_get_double (params_in, groups[i], keys[j], NULL);
-              g_key_file_set_double (params_out, groups[i], "/offset/yaw", -yaw);
-            }
-          else if (g_strcmp0 (keys[j], "/offset/gamma") == 0)
-            {
-              gdouble roll = g_key_file_get_double (params_in, groups[i], keys[j], NULL);
-              g_key_file_set_double (params_out, groups[i], "/offset/roll", -roll);
-            }
-          else if (g_strcmp0 (keys[j], "/offset/theta") == 0)
-            {
-              gdouble pitch = g_key_file_get_double (params_in, groups[i], keys[j], NULL);
-              g_key_file_set_double (params_out, groups[i], "/offset/pitch", -pitch);
-            }
-          else
-            {
-              gchar *value = g_key_file_get_string (params_in, groups[i], keys[j], NULL);
-              g_key_file_set_string (params_out, groups[i], keys[j], value);
-              g_free (value);
-            }
-        }
-
-      g_strfreev (keys);
-    }
-
-  g_strfreev (groups);
-
-  /* Записываем изменённые параметры. */
-  if (!g_key_file_save_to_file (params_out, prm_file, NULL))
-    goto exit;
-
-  /* Обновление схемы параметров галса. */
-  if (!hyscan_fix_track_set_schema (db_path, track_path, HYSCAN_FIX_TRACK_9726336A))
-    goto exit;
-
-  /* Уборка. */
-  status = hyscan_fix_cleanup (db_path);
-
-exit:
-  g_clear_pointer (&params_in, g_key_file_unref);
-  g_clear_pointer (&params_out, g_key_file_unref);
-  g_free (prm_file);
-
-  return status;
+  static const HyScanFixRule rules_19a285f3[] =
+  {
+    HYSCAN_FIX_RENAME ("/offset/x", "/offset/forward", HYSCAN_FIX_VALUE_DOUBLE),
+    HYSCAN_FIX_RENAME ("/offset/y", "/offset/starboard", HYSCAN_FIX_VALUE_DOUBLE),
+    HYSCAN_FIX_RENAME ("/offset/z", "/offset/vertical", HYSCAN_FIX_VALUE_DOUBLE),
+    HYSCAN_FIX_NEGATE ("/offset/psi", "/offset/yaw"),
+    HYSCAN_FIX_NEGATE ("/offset/gamma", "/offset/roll"),
+    HYSCAN_FIX_NEGATE ("/offset/theta", "/offset/pitch")
+  };
+  static HyScanFixRules rules = HYSCAN_FIX_RULES (rules_19a285f3);
+
+  hyscan_fix_track_apply_rules (&rules, params);
+
+  return TRUE;
 }
 
 /* Функция обновляет формат данных галса с версии 9726336a до e8b616cc.
@@ -886,118 +900,49 @@ exit:
  * Добавлен параметр /signal/heterodyne.
  */
 static gboolean
-hyscan_fix_track_9726336a (const gchar *db_path,
-                           const gchar *track_path)
+hyscan_fix_track_9726336a (GKeyFile **params)
 {
-  gboolean status = FALSE;
-  gchar *prm_file = NULL;
-
-  GKeyFile *params = NULL;
-  gchar **groups = NULL;
+  gchar **groups;
   guint i;
 
-  /* Бэкап параметров галса. */
-  prm_file = g_build_filename (track_path, "track.prm", NULL);
-  if (!hyscan_fix_file_backup (db_path, prm_file, TRUE))
-    goto exit;
-
-  /* Преобразование параметров галса. */
-  g_free (prm_file);
-  prm_file = g_build_filename (db_path, track_path, "track.prm", NULL);
-
-  params = g_key_file_new ();
-  if (!g_key_file_load_from_file (params, prm_file, G_KEY_FILE_NONE, NULL))
-    goto exit;
-
   /* Для акустических каналов добавляем параметр /signal/heterodyne. */
-  groups = g_key_file_get_groups (params, NULL);
+  groups = g_key_file_get_groups (*params, NULL);
   for (i = 0; groups != NULL && groups[i] != NULL; i++)
     {
-      gchar *schema_id = g_key_file_get_string (params, groups[i], "schema-id", NULL);
+      gchar *schema_id = g_key_file_get_string (*params, groups[i], "schema-id", NULL);
       if (g_strcmp0 (schema_id, "acoustic") == 0)
         {
-          gdouble frequency = g_key_file_get_double (params, groups[i], "/signal/frequency", NULL);
-          g_key_file_set_double (params, groups[i], "/signal/heterodyne", frequency);
+          gdouble frequency = g_key_file_get_double (*params, groups[i], "/signal/frequency", NULL);
+          g_key_file_set_double (*params, groups[i], "/signal/heterodyne", frequency);
         }
       g_free (schema_id);
     }
 
-  /* Записываем изменённые параметры. */
-  if (!g_key_file_save_to_file (params, prm_file, NULL))
-    goto exit;
-
-  /* Обновление схемы параметров галса. */
-  if (!hyscan_fix_track_set_schema (db_path, track_path, HYSCAN_FIX_TRACK_E8B616CC))
-    goto exit;
-
-  /* Уборка. */
-  status = hyscan_fix_cleanup (db_path);
-
-exit:
-  g_clear_pointer (&params, g_key_file_unref);
-  g_clear_pointer (&groups, g_strfreev);
-  g_free (prm_file);
+  g_strfreev (groups);
 
-  return status;
+  return TRUE;
 }
 
 /* Функция обновляет формат данных галса с версии e8b616cc до 423880d1.
  *
  * Версия e8b616cc являлась внутренней.
  *
- * Добавлен параметр /antenna/group.
+ * Добавлен параметр /antenna/group. В версии e8b616cc этого параметра
+ * нет, поэтому он добавляется со значением по умолчанию.
  */
 static gboolean
-hyscan_fix_track_e8b616cc (const gchar *db_path,
-                           const gchar *track_path)
+hyscan_fix_track_e8b616cc (GKeyFile **params)
 {
-  gboolean status = FALSE;
-  gchar *prm_file = NULL;
-
-  GKeyFile *params = NULL;
-  gchar **groups = NULL;
-  guint i;
-
-  /* Бэкап параметров галса. */
-  prm_file = g_build_filename (track_path, "track.prm", NULL);
-  if (!hyscan_fix_file_backup (db_path, prm_file, TRUE))
-    goto exit;
-
-  /* Преобразование параметров галса. */
-  g_free (prm_file);
-  prm_file = g_build_filename (db_path, track_path, "track.prm", NULL);
-
-  params = g_key_file_new ();
-  if (!g_key_file_load_from_file (params, prm_file, G_KEY_FILE_NONE, NULL))
-    goto exit;
-
   /* Для акустических каналов добавляем параметр /antenna/group. */
-  groups = g_key_file_get_groups (params, NULL);
-  for (i = 0; groups != NULL && groups[i] != NULL; i++)
-    {
-      gchar *schema_id = g_key_file_get_string (params, groups[i], "schema-id", NULL);
-      if (g_strcmp0 (schema_id, "acoustic") == 0)
-        g_key_file_set_int64 (params, groups[i], "/antenna/group", 1);
-      g_free (schema_id);
-    }
-
-  /* Записываем изменённые параметры. */
-  if (!g_key_file_save_to_file (params, prm_file, NULL))
-    goto exit;
-
-  /* Обновление схемы параметров галса. */
-  if (!hyscan_fix_track_set_schema (db_path, track_path, HYSCAN_FIX_TRACK_423880D1))
-    goto exit;
+  static const HyScanFixRule rules_e8b616cc[] =
+  {
+    HYSCAN_FIX_DEFAULT ("/antenna/group", "acoustic", "1")
+  };
+  static HyScanFixRules rules = HYSCAN_FIX_RULES (rules_e8b616cc);
 
-  /* Уборка. */
-  status = hyscan_fix_cleanup (db_path);
-
-exit:
-  g_clear_pointer (&params, g_key_file_unref);
-  g_clear_pointer (&groups, g_strfreev);
-  g_free (prm_file);
+  hyscan_fix_track_apply_rules (&rules, params);
 
-  return status;
+  return TRUE;
 }
 
 /* Функция обновляет формат данных галса с версии 423880d1 до 49a23606.
@@ -1013,44 +958,26 @@ exit:
  * ahrs  -> gnss-ahrs-nmea
  */
 static gboolean
-hyscan_fix_track_423880d1 (const gchar *db_path,
-                           const gchar *track_path)
+hyscan_fix_track_423880d1 (GKeyFile **params)
 {
-  gboolean status = FALSE;
-  gchar *prm_file = NULL;
-
-  GKeyFile *params = NULL;
-  gchar **groups = NULL;
+  gchar **groups;
   guint i;
 
   guint gnss_index = 1;
   guint ahrs_index = 1;
 
-  /* Бэкап параметров галса. */
-  prm_file = g_build_filename (track_path, "track.prm", NULL);
-  if (!hyscan_fix_file_backup (db_path, prm_file, TRUE))
-    goto exit;
-
-  /* Преобразование параметров галса. */
-  g_free (prm_file);
-  prm_file = g_build_filename (db_path, track_path, "track.prm", NULL);
-
-  params = g_key_file_new ();
-  if (!g_key_file_load_from_file (params, prm_file, G_KEY_FILE_NONE, NULL))
-    goto exit;
-
   /* Для каналов датчиков определяем тип данных и изменяем названия. */
-  groups = g_key_file_get_groups (params, NULL);
+  groups = g_key_file_get_groups (*params, NULL);
   for (i = 0; groups != NULL && groups[i] != NULL; i++)
     {
-      gchar *schema_id = g_key_file_get_string (params, groups[i], "schema-id", NULL);
+      gchar *schema_id = g_key_file_get_string (*params, groups[i], "schema-id", NULL);
 
       if (g_strcmp0 (schema_id, "sensor") == 0)
         {
           gchar *cur_name;
           gchar *new_name;
 
-          cur_name = g_key_file_get_string (params, groups[i], "/sensor-name", NULL);
+          cur_name = g_key_file_get_string (*params, groups[i], "/sensor-name", NULL);
           if (g_str_has_prefix (cur_name, "nmea"))
             {
               if (gnss_index == 1)
@@ -1073,7 +1000,7 @@ hyscan_fix_track_423880d1 (const gchar *db_path,
               new_name = g_strdup (cur_name);
             }
 
-          g_key_file_set_string (params, groups[i], "/sensor-name", new_name);
+          g_key_file_set_string (*params, groups[i], "/sensor-name", new_name);
 
           g_free (cur_name);
           g_free (new_name);
@@ -1081,23 +1008,9 @@ hyscan_fix_track_423880d1 (const gchar *db_path,
       g_free (schema_id);
     }
 
-  /* Записываем изменённые параметры. */
-  if (!g_key_file_save_to_file (params, prm_file, NULL))
-    goto exit;
-
-  /* Обновление схемы параметров галса. */
-  if (!hyscan_fix_track_set_schema (db_path, track_path, HYSCAN_FIX_TRACK_49A23606))
-    goto exit;
-
-  /* Уборка. */
-  status = hyscan_fix_cleanup (db_path);
-
-exit:
-  g_clear_pointer (&params, g_key_file_unref);
-  g_clear_pointer (&groups, g_strfreev);
-  g_free (prm_file);
+  g_strfreev (groups);
 
-  return status;
+  return TRUE;
 }
 
 /* Функция обновляет формат данных галса с версии 49a23606 до e4da49a9.
@@ -1108,74 +1021,17 @@ exit:
  * скорости съёмки /plan/velocity-> /plan/speed.
  */
 static gboolean
-hyscan_fix_track_49a23606 (const gchar *db_path,
-                           const gchar *track_path)
+hyscan_fix_track_49a23606 (GKeyFile **params)
 {
-  gboolean status = FALSE;
-  gchar *prm_file = NULL;
-
-  GKeyFile *params_in = NULL;
-  GKeyFile *params_out = NULL;
-  gchar **groups = NULL;
-  guint i, j;
-
-  /* Бэкап параметров галса. */
-  prm_file = g_build_filename (track_path, "track.prm", NULL);
-  if (!hyscan_fix_file_backup (db_path, prm_file, TRUE))
-    goto exit;
-
-  /* Преобразование параметров галса. */
-  g_free (prm_file);
-  prm_file = g_build_filename (db_path, track_path, "track.prm", NULL);
-
-  params_in = g_key_file_new ();
-  if (!g_key_file_load_from_file (params_in, prm_file, G_KEY_FILE_NONE, NULL))
-    goto exit;
-
-  params_out = g_key_file_new ();
-  groups = g_key_file_get_groups (params_in, NULL);
-
-  for (i = 0; groups != NULL && groups[i] != NULL; i++)
-    {
-      gchar **keys = g_key_file_get_keys (params_in, groups[i], NULL, NULL);
-
-      for (j = 0; keys != NULL && keys[j] != NULL; j++)
-        {
-          if (g_strcmp0 (keys[j], "/plan/velocity") == 0)
-            {
-              gdouble speed = g_key_file_get_double (params_in, groups[i], keys[j], NULL);
-              g_key_file_set_double (params_out, groups[i], "/plan/speed", speed);
-            }
-          else
-            {
-              gchar *value = g_key_file_get_string (params_in, groups[i], keys[j], NULL);
-              g_key_file_set_string (params_out, groups[i], keys[j], value);
-              g_free (value);
-            }
-        }
+  static const HyScanFixRule rules_49a23606[] =
+  {
+    HYSCAN_FIX_RENAME ("/plan/velocity", "/plan/speed", HYSCAN_FIX_VALUE_DOUBLE)
+  };
+  static HyScanFixRules rules = HYSCAN_FIX_RULES (rules_49a23606);
 
-      g_strfreev (keys);
-    }
+  hyscan_fix_track_apply_rules (&rules, params);
 
-  g_strfreev (groups);
-
-  /* Записываем изменённые параметры. */
-  if (!g_key_file_save_to_file (params_out, prm_file, NULL))
-    goto exit;
-
-  /* Обновление схемы параметров галса. */
-  if (!hyscan_fix_track_set_schema (db_path, track_path, HYSCAN_FIX_TRACK_E4DA49A9))
-    goto exit;
-
-  /* Уборка. */
-  status = hyscan_fix_cleanup (db_path);
-
-exit:
-  g_clear_pointer (&params_in, g_key_file_unref);
-  g_clear_pointer (&params_out, g_key_file_unref);
-  g_free (prm_file);
-
-  return status;
+  return TRUE;
 }
 
 /* Функция обновляет формат данных галса с версии e4da49a9 до c3d0ad78.
@@ -1187,40 +1043,22 @@ exit:
  * с этой версией, поле /actuator оставляем пустым.
  */
 static gboolean
-hyscan_fix_track_e4da49a9 (const gchar *db_path,
-                           const gchar *track_path)
+hyscan_fix_track_e4da49a9 (GKeyFile **params)
 {
-  gboolean status = FALSE;
-  gchar *prm_file = NULL;
-
-  GKeyFile *params = NULL;
-  gchar **groups = NULL;
+  gchar **groups;
   guint i;
 
-  /* Бэкап параметров галса. */
-  prm_file = g_build_filename (track_path, "track.prm", NULL);
-  if (!hyscan_fix_file_backup (db_path, prm_file, TRUE))
-    goto exit;
-
-  /* Преобразование параметров галса. */
-  g_free (prm_file);
-  prm_file = g_build_filename (db_path, track_path, "track.prm", NULL);
-
-  params = g_key_file_new ();
-  if (!g_key_file_load_from_file (params, prm_file, G_KEY_FILE_NONE, NULL))
-    goto exit;
-
   /* Для акустических каналов добавляем параметр /description. */
-  groups = g_key_file_get_groups (params, NULL);
+  groups = g_key_file_get_groups (*params, NULL);
   for (i = 0; groups != NULL && groups[i] != NULL; i++)
     {
-      gchar *schema_id = g_key_file_get_string (params, groups[i], "schema-id", NULL);
+      gchar *schema_id = g_key_file_get_string (*params, groups[i], "schema-id", NULL);
       if (g_strcmp0 (schema_id, "acoustic") == 0)
         {
           const gchar *description;
           gdouble frequency;
 
-          frequency = g_key_file_get_double (params, groups[i], "/signal/frequency", NULL);
+          frequency = g_key_file_get_double (*params, groups[i], "/signal/frequency", NULL);
           if (g_strrstr (groups[i], "forward-look") != NULL)
             {
               description = "400";
@@ -1255,77 +1093,64 @@ hyscan_fix_track_e4da49a9 (const gchar *db_path,
               description = "1200";
             }
 
-          g_key_file_set_string (params, groups[i], "/description", description);
+          g_key_file_set_string (*params, groups[i], "/description", description);
         }
       g_free (schema_id);
     }
 
-  /* Записываем изменённые параметры. */
-  if (!g_key_file_save_to_file (params, prm_file, NULL))
-    goto exit;
-
-  /* Обновление схемы параметров галса. */
-  if (!hyscan_fix_track_set_schema (db_path, track_path, HYSCAN_FIX_TRACK_C3D0AD78))
-    goto exit;
-
-  /* Уборка. */
-  status = hyscan_fix_cleanup (db_path);
-
-exit:
-  g_clear_pointer (&params, g_key_file_unref);
-  g_clear_pointer (&groups, g_strfreev);
-  g_free (prm_file);
+  g_strfreev (groups);
 
-  return status;
+  return TRUE;
 }
 
 /**
- * hyscan_fix_track_get_version:
+ * hyscan_fix_track_probe_version:
  * @db_path: путь к базе данных (каталог с проектами)
- * @track_path: путь к проекту относительно db_path
+ * @track_path: путь к галсу относительно db_path
  *
- * Функция определяет версию формата данных галса.
+ * Функция определяет версию формата данных галса. Функция ничего не
+ * записывает в базу данных, в том числе в журнал обновления.
  *
  * Returns: Версия формата данных галса.
  */
 HyScanFixTrackVersion
-hyscan_fix_track_get_version (const gchar *db_path,
-                              const gchar *track_path)
+hyscan_fix_track_probe_version (const gchar *db_path,
+                                const gchar *track_path)
 {
   HyScanFixTrackVersion version = HYSCAN_FIX_TRACK_NOT_TRACK;
   HyScanFixFileIDType id;
 
+  const HyScanFixSchema *schema = NULL;
   gchar *id_file = NULL;
   gchar *sch_file = NULL;
   gchar *sch_md5 = NULL;
 
-  id_file = g_build_filename (track_path, "track.id", NULL);
-  id = hyscan_fix_file_db_id (db_path, id_file);
-  if ((GUINT32_FROM_LE (id.magic) != TRACK_FILE_MAGIC) ||
-      (GUINT32_FROM_LE (id.version) != TRACK_FILE_VERSION))
-    {
-      goto exit;
-    }
-
-  version = HYSCAN_FIX_TRACK_UNKNOWN;
-
+  /* Контрольная сумма схемы неизменённого файла берётся из кэша. В кэш
+   * попадают только файлы с проверенным идентификатором. */
   sch_file = g_build_filename (track_path, "track.sch", NULL);
-  sch_md5 = hyscan_fix_file_md5 (db_path, sch_file);
-  if (sch_md5 == NULL)
-    goto exit;
-
-  while (version < HYSCAN_FIX_TRACK_LAST)
+  sch_md5 = hyscan_fix_cache_lookup (db_path, sch_file);
+  if (sch_md5 != NULL)
     {
-      if (g_strcmp0 (sch_md5, hyscan_fix_track_get_hash (version)) == 0)
-        break;
-      version += 1;
+      schema = hyscan_fix_schema_find (HYSCAN_FIX_SCHEMA_TRACK, sch_md5);
     }
+  else
+    {
+      id_file = g_build_filename (track_path, "track.id", NULL);
+      id = hyscan_fix_file_db_id (db_path, id_file);
+      if ((GUINT32_FROM_LE (id.magic) != TRACK_FILE_MAGIC) ||
+          (GUINT32_FROM_LE (id.version) != TRACK_FILE_VERSION))
+        {
+          goto exit;
+        }
 
-  if (version == HYSCAN_FIX_TRACK_LAST)
-    version = HYSCAN_FIX_TRACK_UNKNOWN;
+      /* Файл схемы сравнивается с таблицей известных схем сначала по
+       * размеру и только затем по контрольной сумме. */
+      schema = hyscan_fix_schema_detect (HYSCAN_FIX_SCHEMA_TRACK, db_path, sch_file);
+      if (schema != NULL)
+        hyscan_fix_cache_update (db_path, sch_file, schema->md5);
+    }
 
-  if (version == HYSCAN_FIX_TRACK_UNKNOWN)
-    hyscan_fix_log (db_path, "unknown track version %s - %s", track_path, sch_md5);
+  version = (schema != NULL) ? schema->version : HYSCAN_FIX_TRACK_UNKNOWN;
 
 exit:
   g_free (sch_md5);
@@ -1335,77 +1160,299 @@ exit:
   return version;
 }
 
+/* Функция добавляет к оценке затрат резервное копирование и перезапись
+ * файла. Размер нового файла принимается равным размеру исходного. */
+static void
+hyscan_fix_track_estimate_file (const gchar   *db_path,
+                                const gchar   *track_path,
+                                const gchar   *name,
+                                gsize          new_size,
+                                HyScanFixCost *cost)
+{
+  GStatBuf info;
+  gchar *file;
+
+  file = g_build_filename (db_path, track_path, name, NULL);
+  if (g_stat (file, &info) == 0)
+    {
+      cost->read_bytes += info.st_size;
+      cost->write_bytes += info.st_size + ((new_size > 0) ? new_size : (gsize)info.st_size);
+      cost->n_files += 2;
+    }
+  g_free (file);
+}
+
+/* Функция оценивает затраты на перенос данных каналов при обновлении
+ * с версии 2f9c8a44. Файлы каналов, у которых изменилось название,
+ * переименовываются, а если целевой файл уже существует - копируются.
+ * Файлы остальных каналов удаляются. */
+static gboolean
+hyscan_fix_track_estimate_2f9c8a44 (const gchar   *db_path,
+                                    const gchar   *track_path,
+                                    HyScanFixCost *cost)
+{
+  HyScanFixKeyFile *params = NULL;
+  GHashTable *segments = NULL;
+  GHashTableIter iter;
+  gpointer key, value;
+  gboolean status = FALSE;
+  gchar *prm_file;
+
+  /* Из параметров галса нужен только список каналов. */
+  prm_file = g_build_filename (db_path, track_path, "track.prm", NULL);
+  params = hyscan_fix_key_file_new (prm_file);
+  if (params == NULL)
+    goto exit;
+
+  segments = hyscan_fix_track_segments_new (db_path, track_path);
+  if (segments == NULL)
+    goto exit;
+
+  g_hash_table_iter_init (&iter, segments);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      const gchar *src_channel = key;
+      const gchar *dst_channel;
+      GArray *flags = value;
+      guint i;
+
+      /* Обновляются только каналы, описанные в параметрах галса. */
+      if (!hyscan_fix_key_file_has_group (params, src_channel))
+        continue;
+
+      dst_channel = hyscan_fix_track_update_channel_name_2f9c8a44 (src_channel);
+      if (g_strcmp0 (src_channel, dst_channel) == 0)
+        continue;
+
+      for (i = 0; i < flags->len; i++)
+        {
+          const gchar *types[] = { "i", "d" };
+          guint j;
+
+          for (j = 0; j < G_N_ELEMENTS (types); j++)
+            {
+              gchar *src_file;
+              gchar *dst_file;
+              GStatBuf info;
+
+              if (!(g_array_index (flags, guint8, i) & ((j == 0) ? SEGMENT_INDEX : SEGMENT_DATA)))
+                continue;
+
+              cost->n_files += 1;
+              if (dst_channel == NULL)
+                continue;
+
+              src_file = g_strdup_printf ("%s%c%s.%06d.%s", track_path, G_DIR_SEPARATOR, src_channel, i, types[j]);
+              dst_file = g_strdup_printf ("%s%c%s.%06d.%s", track_path, G_DIR_SEPARATOR, dst_channel, i, types[j]);
+
+              if (hyscan_fix_file_exist (db_path, dst_file))
+                {
+                  gchar *file = g_build_filename (db_path, src_file, NULL);
+
+                  if (g_stat (file, &info) == 0)
+                    {
+                      cost->read_bytes += info.st_size;
+                      cost->write_bytes += info.st_size;
+                      cost->copy_bytes += info.st_size;
+                    }
+                  g_free (file);
+                }
+
+              g_free (src_file);
+              g_free (dst_file);
+            }
+        }
+    }
+
+  status = TRUE;
+
+exit:
+  g_clear_pointer (&segments, g_hash_table_unref);
+  hyscan_fix_key_file_free (params);
+  g_free (prm_file);
+
+  return status;
+}
+
 /**
- * hyscan_fix_track:
+ * hyscan_fix_track_estimate:
  * @db_path: путь к базе данных (каталог с проектами)
- * @track_path: путь к проекту относительно db_path
- * @cancellable: указатель на #HyScanCancellable
+ * @track_path: путь к галсу относительно db_path
+ * @version: текущая версия формата данных галса
+ * @cost: (out): оценка затрат
  *
- * Функция обновляет формат данных галса. При этом происходит
- * последовательное обновление формата данных от одной версии
- * к другой, до текущей используемой в HyScan.
+ * Функция оценивает затраты на обновление галса без изменения данных.
+ * Оценка предполагает создание резервных копий копированием файлов.
  *
- * Returns: %TRUE если обновление успешно завершено, иначе %FALSE.
+ * Returns: %TRUE если оценка выполнена, иначе %FALSE.
  */
 gboolean
-hyscan_fix_track (const gchar       *db_path,
-                  const gchar       *track_path,
-                  HyScanCancellable *cancellable)
+hyscan_fix_track_estimate (const gchar           *db_path,
+                           const gchar           *track_path,
+                           HyScanFixTrackVersion  version,
+                           HyScanFixCost         *cost)
+{
+  const HyScanFixSchema *schema;
+
+  memset (cost, 0, sizeof (*cost));
+
+  if ((version == HYSCAN_FIX_TRACK_NOT_TRACK) || (version == HYSCAN_FIX_TRACK_LATEST))
+    return TRUE;
+  if ((version == HYSCAN_FIX_TRACK_UNKNOWN) || (version == HYSCAN_FIX_TRACK_LAST))
+    return FALSE;
+
+  schema = hyscan_fix_schema_get (HYSCAN_FIX_SCHEMA_TRACK, HYSCAN_FIX_TRACK_LATEST);
+
+  hyscan_fix_track_estimate_file (db_path, track_path, "track.prm", 0, cost);
+  hyscan_fix_track_estimate_file (db_path, track_path, "track.sch", schema->size, cost);
+
+  if (version == HYSCAN_FIX_TRACK_2F9C8A44)
+    return hyscan_fix_track_estimate_2f9c8a44 (db_path, track_path, cost);
+
+  return TRUE;
+}
+
+/* Функция обновляет формат данных галса. Параметры галса загружаются
+ * один раз, все шаги обновления выполняются над ними в памяти, после
+ * чего параметры, если они изменились, и схема записываются в рамках
+ * одного набора резервных копий. */
+static gboolean
+hyscan_fix_track_upgrade (const gchar       *db_path,
+                          const gchar       *track_path,
+                          HyScanCancellable *cancellable)
 {
   HyScanFixTrackVersion version;
-  gboolean status = TRUE;
+  gboolean status = FALSE;
+  gchar *prm_file = NULL;
+  gchar *bak_file = NULL;
+  gchar *prm_data = NULL;
+  gchar *new_data = NULL;
+  gsize prm_size = 0;
+  gsize new_size = 0;
+  GKeyFile *params = NULL;
 
-  /* Проверяем состояние базы данных и откатываем изменения
+  /* Проверяем состояние галса и откатываем изменения
    * в случае ошибки при предыдущем обновлении. */
   if (!hyscan_fix_revert (db_path))
     return FALSE;
 
-  version = hyscan_fix_track_get_version (db_path, track_path);
-  switch (version)
-    {
-    case HYSCAN_FIX_TRACK_NOT_TRACK:
-      status = TRUE;
-      break;
+  version = hyscan_fix_track_probe_version (db_path, track_path);
+  if ((version == HYSCAN_FIX_TRACK_NOT_TRACK) || (version == HYSCAN_FIX_TRACK_LATEST))
+    return TRUE;
+  if ((version == HYSCAN_FIX_TRACK_UNKNOWN) || (version == HYSCAN_FIX_TRACK_LAST))
+    return FALSE;
 
-    case HYSCAN_FIX_TRACK_UNKNOWN:
-      status = FALSE;
-      break;
+  /* Загрузка параметров галса. Исходное содержимое файла сохраняется
+   * для сравнения с преобразованными параметрами. */
+  prm_file = g_build_filename (db_path, track_path, "track.prm", NULL);
+  if (!g_file_get_contents (prm_file, &prm_data, &prm_size, NULL))
+    goto exit;
 
+  params = g_key_file_new ();
+  if (!g_key_file_load_from_data (params, prm_data, prm_size, G_KEY_FILE_NONE, NULL))
+    goto exit;
+
+  /* Преобразование параметров галса. */
+  status = TRUE;
+  switch (version)
+    {
     case HYSCAN_FIX_TRACK_2F9C8A44:
       if (status)
-        status = hyscan_fix_track_2f9c8a44 (db_path, track_path, cancellable);
+        status = hyscan_fix_track_2f9c8a44 (db_path, track_path, &params, cancellable);
 
     case HYSCAN_FIX_TRACK_19A285F3:
       if (status)
-        status = hyscan_fix_track_19a285f3 (db_path, track_path);
+        status = hyscan_fix_track_19a285f3 (&params);
 
     case HYSCAN_FIX_TRACK_9726336A:
       if (status)
-        status = hyscan_fix_track_9726336a (db_path, track_path);
+        status = hyscan_fix_track_9726336a (&params);
 
     case HYSCAN_FIX_TRACK_E8B616CC:
       if (status)
-        status = hyscan_fix_track_e8b616cc (db_path, track_path);
+        status = hyscan_fix_track_e8b616cc (&params);
 
     case HYSCAN_FIX_TRACK_423880D1:
       if (status)
-        status = hyscan_fix_track_423880d1 (db_path, track_path);
+        status = hyscan_fix_track_423880d1 (&params);
 
     case HYSCAN_FIX_TRACK_49A23606:
       if (status)
-        status = hyscan_fix_track_49a23606 (db_path, track_path);
+        status = hyscan_fix_track_49a23606 (&params);
 
     case HYSCAN_FIX_TRACK_E4DA49A9:
       if (status)
-        status = hyscan_fix_track_e4da49a9 (db_path, track_path);
+        status = hyscan_fix_track_e4da49a9 (&params);
 
-    case HYSCAN_FIX_TRACK_C3D0AD78:
+    default:
       break;
+    }
 
-    case HYSCAN_FIX_TRACK_LAST:
-      status = FALSE;
-      break;
+  if (!status)
+    goto exit;
+
+  status = FALSE;
+
+  /* Если шаги обновления не изменили параметры, например в галсе нет
+   * акустических каналов, файл не копируется и не перезаписывается. */
+  new_data = g_key_file_to_data (params, &new_size, NULL);
+  if ((new_size != prm_size) || (memcmp (new_data, prm_data, prm_size) != 0))
+    {
+      /* Бэкап параметров галса. */
+      bak_file = g_build_filename (track_path, "track.prm", NULL);
+      if (!hyscan_fix_file_backup (db_path, bak_file, TRUE))
+        goto exit;
+
+      /* Записываем изменённые параметры. */
+      if (!g_file_set_contents (prm_file, new_data, new_size, NULL))
+        goto exit;
     }
 
+  /* Обновление схемы параметров галса. */
+  if (!hyscan_fix_track_set_schema (db_path, track_path, HYSCAN_FIX_TRACK_LATEST))
+    goto exit;
+
+  /* Уборка. */
+  status = hyscan_fix_cleanup (db_path);
+
+exit:
+  g_clear_pointer (&params, g_key_file_unref);
+  g_free (prm_file);
+  g_free (bak_file);
+  g_free (prm_data);
+  g_free (new_data);
+
+  return status;
+}
+
+/**
+ * hyscan_fix_track:
+ * @db_path: путь к базе данных (каталог с проектами)
+ * @track_path: путь к проекту относительно db_path
+ * @cancellable: указатель на #HyScanCancellable
+ *
+ * Функция обновляет формат данных галса. При этом происходит
+ * последовательное обновление формата данных от одной версии
+ * к другой, до текущей используемой в HyScan.
+ *
+ * Журналы обновления галса хранятся в его каталоге, поэтому разные
+ * галсы можно обновлять параллельно.
+ *
+ * Returns: %TRUE если обновление успешно завершено, иначе %FALSE.
+ */
+gboolean
+hyscan_fix_track (const gchar       *db_path,
+                  const gchar       *track_path,
+                  HyScanCancellable *cancellable)
+{
+  gboolean status;
+  gchar *track_root;
+
+  /* Пути к файлам галса указываются относительно его каталога. */
+  track_root = g_build_filename (db_path, track_path, NULL);
+  status = hyscan_fix_track_upgrade (track_root, "", cancellable);
+  hyscan_fix_journal_close (track_root);
+  g_free (track_root);
+
   return status;
 }
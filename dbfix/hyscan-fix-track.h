@@ -36,6 +36,7 @@
 #define __HYSCAN_FIX_TRACK_H__
 
 #include <hyscan-cancellable.h>
+#include "hyscan-fix-common.h"
 
 G_BEGIN_DECLS
 
@@ -55,12 +56,18 @@ typedef enum
   HYSCAN_FIX_TRACK_LAST
 } HyScanFixTrackVersion;
 
-HyScanFixTrackVersion  hyscan_fix_track_get_version   (const gchar        *db_path,
-                                                       const gchar        *track_path);
+HyScanFixTrackVersion  hyscan_fix_track_probe_version (const gchar           *db_path,
+                                                       const gchar           *track_path);
 
-gboolean               hyscan_fix_track               (const gchar        *db_path,
-                                                       const gchar        *track_path,
-                                                       HyScanCancellable  *cancellable);
+
+gboolean               hyscan_fix_track_estimate      (const gchar           *db_path,
+                                                       const gchar           *track_path,
+                                                       HyScanFixTrackVersion  version,
+                                                       HyScanFixCost         *cost);
+
+gboolean               hyscan_fix_track               (const gchar           *db_path,
+                                                       const gchar           *track_path,
+                                                       HyScanCancellable     *cancellable);
 
 G_END_DECLS
 